@@ -0,0 +1,82 @@
+# C++ keywords that names in nif.xml, such as those of the basic types, may clash with.
+CPP_KEYWORDS = Set[ "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+  "case", "catch", "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr", "const_cast",
+  "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit",
+  "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+  "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+  "protected", "public", "register", "reinterpret_cast", "return", "short", "signed", "sizeof", "static",
+  "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+  "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile",
+  "wchar_t", "while", "xor", "xor_eq" ]
+
+# Maps arbitrary names from nif.xml to unique C++ identifiers.
+class IdentifierPool
+  def initialize(prefix, reserved = [])
+    @prefix = prefix
+    @identifiers = {}
+    @used = Set.new reserved
+  end
+
+  def get(name)
+    existing = @identifiers[name]
+    return existing unless existing.nil?
+
+    base = @prefix + name.gsub(/[^A-Za-z0-9]/, "_")
+    identifier = base
+    suffix = 2
+    while @used.include? identifier
+      identifier = "#{base}_#{suffix}"
+      suffix += 1
+    end
+
+    @used.add identifier
+    @identifiers[name] = identifier
+  end
+
+  def each(&block)
+    @identifiers.each(&block)
+  end
+end
+
+# Names of the constants in the generated Symbols.h. Every name that
+# nif.xml defines is given its identifier up front, in sorted order, so
+# that all generators agree on them whatever order they use names in.
+class SymbolIdentifiers
+  def initialize(desc)
+    @identifiers = {}
+    @used = Set.new
+
+    names = Set[ "Version", "User Version", "User Version 2" ]
+    desc.types.each_value do |typeinfo|
+      names.add typeinfo.name
+      names.merge typeinfo.fields.map(&:name) if typeinfo.kind_of? NIFCompound
+      names.merge typeinfo.options.map(&:name) if typeinfo.kind_of?(NIFEnum) || typeinfo.kind_of?(NIFBitflags)
+    end
+
+    names.sort.each { |name| get name }
+  end
+
+  def get(name)
+    existing = @identifiers[name]
+    return existing unless existing.nil?
+
+    # Names that start with a digit, such as some enum options, get a leading underscore, and keywords a trailing one.
+    base = name =~ /\A[A-Za-z_]/ ? name : "_" + name
+    base += "_" if CPP_KEYWORDS.include? base
+    base = base.gsub(/[^A-Za-z0-9]/, "_")
+
+    identifier = base
+    suffix = 2
+    while @used.include? identifier
+      identifier = "#{base}_#{suffix}"
+      suffix += 1
+    end
+
+    @used.add identifier
+    @identifiers[name] = identifier
+  end
+end
+
+def cpp_string(string)
+  '"' + string.gsub(/[\\"]/) { |c| "\\" + c } + '"'
+end
@@ -3,6 +3,7 @@ require 'pp'
 require 'fileutils'
 require 'strscan'
 require 'stringio'
+require 'set'
 
 require_relative 'nif_version'
 require_relative 'nif_type'
@@ -15,3 +16,4 @@ require_relative 'nif_compound'
 require_relative 'nif_niobject'
 require_relative 'nifxml'
 require_relative 'expression_parser'
+require_relative 'cpp_output'
@@ -5,4 +5,18 @@ class NIFVersion
     @version = version
     @description = description
   end
+
+  def self.literal(string)
+    parts = string.split(".").map { |v| Integer(v, 10) }
+
+    if parts.size > 4
+      raise "too many parts in version: #{string}"
+    end
+
+    while parts.size < 4
+      parts.push 0
+    end
+
+    ((parts[0] & 0xFF) << 24) | ((parts[1] & 0xFF) << 16) | ((parts[2] & 0xFF) << 8) | (parts[3] & 0xFF)
+  end
 end
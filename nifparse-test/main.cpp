@@ -1,13 +1,168 @@
+#include <nifparse/NIFBatchLoader.h>
 #include <nifparse/NIFFile.h>
+#include <nifparse/Serializer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
 
-int main(int argc, char *argv[]) {
-	std::fstream nifFileStream;
-	nifFileStream.exceptions(std::ios::failbit | std::ios::eofbit | std::ios::badbit);
-	nifFileStream.open("C:\\projects\\nifparse\\meshes\\ex_hlaalu_b_01.nif", std::ios::in | std::ios::binary);
+/*
+ * Loads every .nif file in the directories (or the files) given on the
+ * command line with NIFBatchLoader, and reports the throughput.
+ *
+ * With -b, instead reads the files into memory and parses them repeatedly on
+ * this thread with the bytecode interpreter, reporting the time per executed
+ * instruction of the best pass. Instructions are only counted when nifparse
+ * is built with NIFPARSE_INTERPRETER_STATS; building it once more with
+ * NIFPARSE_SWITCH_DISPATCH as well compares the two dispatch methods.
+ *
+ * Usage: nifparse-test [-j threads] [-b passes] path...
+ */
+
+static bool isNifFile(const std::filesystem::path &path) {
+	auto extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	return extension == ".nif";
+}
+
+static int benchmarkInterpreter(const std::vector<std::filesystem::path> &files, unsigned int passes) {
+	std::vector<std::vector<unsigned char>> contents;
+
+	for (const auto &file : files) {
+		std::ifstream stream(file, std::ios::in | std::ios::binary);
+		contents.emplace_back(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	}
+
+	std::chrono::steady_clock::duration best = std::chrono::steady_clock::duration::max();
+	uint64_t instructions = 0;
+
+	for (unsigned int pass = 0; pass < passes; pass++) {
+		std::chrono::steady_clock::duration elapsed(0);
+		auto executedBefore = nifparse::Serializer::executedInstructions();
 
-	nifparse::NIFFile file;
-	file.parse(nifFileStream);
+		for (size_t index = 0; index < files.size(); index++) {
+			nifparse::NIFFile file;
+			file.setUseNativeCode(false);
+
+			try {
+				auto start = std::chrono::steady_clock::now();
+				file.parse(contents[index].data(), contents[index].size());
+				elapsed += std::chrono::steady_clock::now() - start;
+			}
+			catch (const std::exception &e) {
+				std::cerr << files[index].string() << ": " << e.what() << "\n";
+				return 1;
+			}
+		}
+
+		instructions = nifparse::Serializer::executedInstructions() - executedBefore;
+		best = std::min(best, elapsed);
+	}
+
+	std::chrono::duration<double, std::milli> bestMs = best;
+
+	std::cout << files.size() << " files, best of " << passes << " passes: " << bestMs.count() << " ms";
+
+	if (instructions == 0) {
+		std::cout << "; build nifparse with NIFPARSE_INTERPRETER_STATS to count instructions\n";
+	}
+	else {
+		std::chrono::duration<double, std::nano> bestNs = best;
+		std::cout << ", " << instructions << " instructions: " << (bestNs.count() / instructions) << " ns/instruction\n";
+	}
 
 	return 0;
 }
+
+int main(int argc, char *argv[]) {
+	unsigned int threads = 0;
+	unsigned int passes = 0;
+	std::vector<std::filesystem::path> paths;
+
+	for (int index = 1; index < argc; index++) {
+		if (strcmp(argv[index], "-j") == 0 && index + 1 < argc) {
+			threads = static_cast<unsigned int>(strtoul(argv[++index], nullptr, 10));
+		}
+		else if (strcmp(argv[index], "-b") == 0 && index + 1 < argc) {
+			passes = static_cast<unsigned int>(strtoul(argv[++index], nullptr, 10));
+		}
+		else {
+			paths.emplace_back(argv[index]);
+		}
+	}
+
+	if (paths.empty()) {
+		std::cerr << "Usage: " << argv[0] << " [-j threads] [-b passes] path...\n";
+		return 1;
+	}
+
+	std::vector<std::filesystem::path> files;
+	uintmax_t totalBytes = 0;
+
+	for (const auto &path : paths) {
+		if (std::filesystem::is_directory(path)) {
+			for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+				if (entry.is_regular_file() && isNifFile(entry.path())) {
+					files.emplace_back(entry.path());
+					totalBytes += entry.file_size();
+				}
+			}
+		}
+		else {
+			files.emplace_back(path);
+			totalBytes += std::filesystem::file_size(path);
+		}
+	}
+
+	if (passes != 0)
+		return benchmarkInterpreter(files, passes);
+
+	std::atomic<size_t> loaded(0);
+	std::atomic<size_t> failed(0);
+	std::mutex outputMutex;
+
+	nifparse::NIFBatchLoader loader(threads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (const auto &file : files) {
+		loader.loadAsync(file.string(), [&](nifparse::NIFBatchLoader::Result &&result) {
+			if (result.file) {
+				loaded++;
+				return;
+			}
+
+			failed++;
+
+			std::unique_lock<std::mutex> locker(outputMutex);
+			try {
+				std::rethrow_exception(result.error);
+			}
+			catch (const std::exception &e) {
+				std::cerr << result.path << ": " << e.what() << "\n";
+			}
+			catch (...) {
+				std::cerr << result.path << ": unknown error\n";
+			}
+		});
+	}
+
+	loader.wait();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << loaded << " files loaded, " << failed << " failed, on " << loader.threadCount() << " threads in " << elapsed.count() << " s: "
+		<< (files.size() / elapsed.count()) << " files/s, " << (totalBytes / elapsed.count() / (1024 * 1024)) << " MiB/s\n";
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#ifndef NIFPARSE_ALLOCATOR_H
+#define NIFPARSE_ALLOCATOR_H
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace nifparse {
+	/*
+	 * Memory resource that containers of the parsed tree allocate from when
+	 * they are created on this thread. NIFFile::parse installs the file's arena
+	 * here for the duration of the parse. Unlike the default resource of
+	 * std::pmr::polymorphic_allocator, this is per thread, so files parsed on
+	 * different threads never share an arena.
+	 */
+	std::pmr::memory_resource *currentMemoryResource();
+
+	class MemoryResourceScope {
+	public:
+		explicit MemoryResourceScope(std::pmr::memory_resource *resource);
+		~MemoryResourceScope();
+
+		MemoryResourceScope(const MemoryResourceScope &other) = delete;
+		MemoryResourceScope &operator =(const MemoryResourceScope &other) = delete;
+
+	private:
+		std::pmr::memory_resource *m_previous;
+	};
+
+	/*
+	 * Allocator of the containers in Types.h. A container keeps the resource
+	 * it was created with; copies allocate from the resource current at the
+	 * time of the copy, so copying a value out of a tree detaches it from the
+	 * tree's arena.
+	 */
+	template<typename T>
+	class NIFAllocator {
+	public:
+		using value_type = T;
+
+		inline NIFAllocator() noexcept : m_resource(currentMemoryResource()) { }
+		inline NIFAllocator(std::pmr::memory_resource *resource) noexcept : m_resource(resource) { }
+
+		template<typename U>
+		inline NIFAllocator(const NIFAllocator<U> &other) noexcept : m_resource(other.resource()) { }
+
+		inline T *allocate(size_t count) {
+			return static_cast<T *>(m_resource->allocate(count * sizeof(T), alignof(T)));
+		}
+
+		inline void deallocate(T *pointer, size_t count) noexcept {
+			m_resource->deallocate(pointer, count * sizeof(T), alignof(T));
+		}
+
+		inline NIFAllocator select_on_container_copy_construction() const {
+			return NIFAllocator();
+		}
+
+		inline std::pmr::memory_resource *resource() const { return m_resource; }
+
+	private:
+		std::pmr::memory_resource *m_resource;
+	};
+
+	template<typename T, typename U>
+	inline bool operator ==(const NIFAllocator<T> &a, const NIFAllocator<U> &b) noexcept {
+		return a.resource() == b.resource() || *a.resource() == *b.resource();
+	}
+
+	template<typename T, typename U>
+	inline bool operator !=(const NIFAllocator<T> &a, const NIFAllocator<U> &b) noexcept {
+		return !(a == b);
+	}
+
+	template<typename T>
+	using NIFVector = std::vector<T, NIFAllocator<T>>;
+
+	using NIFString = std::basic_string<char, std::char_traits<char>, NIFAllocator<char>>;
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 
 namespace nifparse {
 	class BytecodeReader {
@@ -24,6 +25,9 @@ namespace nifparse {
 		size_t position() const;
 
 	private:
+		// Reading the bytecode is bounds checked, as it is only done while compiling plans.
+		void require(size_t length) const;
+
 		const uint8_t *m_ptr;
 	};
 }
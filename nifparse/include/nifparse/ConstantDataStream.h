@@ -11,9 +11,12 @@ namespace nifparse {
 
 		virtual void readBytes(unsigned char *bytes, size_t size) override;
 		virtual void writeBytes(const unsigned char *bytes, size_t size) override;
+		virtual size_t position() const override;
+		virtual void seek(size_t position) override;
+		virtual const unsigned char *window(size_t &size) override;
 
 	private:
-		const unsigned char *m_ptr, *m_end;
+		const unsigned char *m_begin, *m_ptr, *m_end;
 	};
 }
 
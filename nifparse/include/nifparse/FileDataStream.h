@@ -12,6 +12,8 @@ namespace nifparse {
 
 		virtual void readBytes(unsigned char *bytes, size_t size) override;
 		virtual void writeBytes(const unsigned char *bytes, size_t size) override;
+		virtual size_t position() const override;
+		virtual void seek(size_t position) override;
 
 	private:
 		std::iostream &m_stream;
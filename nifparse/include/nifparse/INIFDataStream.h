@@ -2,6 +2,7 @@
 #define NIFPARSE_I_NIF_DATA_STREAM_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 namespace nifparse {
 	class INIFDataStream {
@@ -15,6 +16,27 @@ namespace nifparse {
 	public:
 		virtual void readBytes(unsigned char *bytes, size_t size) = 0;
 		virtual void writeBytes(const unsigned char *bytes, size_t size) = 0;
+		virtual size_t position() const = 0;
+		virtual void seek(size_t position) = 0;
+
+		/*
+		 * Memory-backed streams return the bytes available at the current
+		 * position, which SerializerContext then consumes directly, syncing
+		 * the position back with seek(). Other streams return nullptr.
+		 */
+		virtual const unsigned char *window(size_t &size) {
+			size = 0;
+			return nullptr;
+		}
+
+		/*
+		 * False for streams that buffer only part of the data, whose window
+		 * may end before the end of the stream and is only valid until the
+		 * next call to window(), seek() or readBytes().
+		 */
+		virtual bool windowCoversStream() const {
+			return true;
+		}
 	};
 }
 
@@ -0,0 +1,46 @@
+#ifndef NIFPARSE_MAPPED_FILE_DATA_STREAM_H
+#define NIFPARSE_MAPPED_FILE_DATA_STREAM_H
+
+#include <nifparse/INIFDataStream.h>
+
+namespace nifparse {
+	class MappedFileDataStream final : public INIFDataStream {
+	public:
+		enum class AccessHint {
+			Normal,
+			Sequential,
+			Random,
+			WillNeed,
+			DontNeed
+		};
+
+		explicit MappedFileDataStream(const char *filename);
+		~MappedFileDataStream();
+
+		virtual void readBytes(unsigned char *bytes, size_t size) override;
+		virtual void writeBytes(const unsigned char *bytes, size_t size) override;
+		virtual size_t position() const override;
+		virtual void seek(size_t position) override;
+		virtual const unsigned char *window(size_t &size) override;
+
+		void advise(AccessHint hint);
+		void advise(AccessHint hint, size_t offset, size_t length);
+
+		inline const unsigned char *data() const { return m_begin; }
+		inline size_t size() const { return m_end - m_begin; }
+
+	private:
+		void unmap();
+
+		const unsigned char *m_begin, *m_ptr, *m_end;
+
+#ifdef _WIN32
+		void *m_file;
+		void *m_mapping;
+#else
+		int m_fd;
+#endif
+	};
+}
+
+#endif
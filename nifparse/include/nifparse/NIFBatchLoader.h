@@ -0,0 +1,97 @@
+#ifndef NIFPARSE_NIF_BATCH_LOADER_H
+#define NIFPARSE_NIF_BATCH_LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nifparse {
+	class NIFFile;
+
+	/*
+	 * Loads many files on a pool of worker threads. Each worker takes loads
+	 * from a queue of its own and steals from the others when it runs out, so
+	 * a few large files do not hold up the rest. Files are parsed by name,
+	 * and a failed or cancelled load only affects its own result.
+	 */
+	class NIFBatchLoader {
+	public:
+		// Defined where NIFFile is complete, so that this header does not need it.
+		struct Result {
+			Result();
+			~Result();
+
+			Result(Result &&other);
+			Result &operator =(Result &&other);
+
+			std::string path;
+
+			// Null if the load failed or was cancelled.
+			std::unique_ptr<NIFFile> file;
+			std::exception_ptr error;
+			bool cancelled;
+		};
+
+		// Called on the worker thread that loaded the file. Must not throw.
+		using Completion = std::function<void(Result &&result)>;
+
+		// Called on a worker thread for every file before it is parsed, to set its options.
+		using FileSetup = std::function<void(NIFFile &file)>;
+
+		// 0 starts a worker for every hardware thread.
+		explicit NIFBatchLoader(unsigned int threads = 0);
+
+		// Cancels the loads that have not started yet and waits for the others.
+		~NIFBatchLoader();
+
+		NIFBatchLoader(const NIFBatchLoader &other) = delete;
+		NIFBatchLoader &operator =(const NIFBatchLoader &other) = delete;
+
+		// Workers whose thread started; fewer than asked for if the system ran out of threads.
+		inline size_t threadCount() const { return m_threadCount; }
+
+		// Only to be changed while no loads are pending.
+		inline const FileSetup &fileSetup() const { return m_fileSetup; }
+		inline void setFileSetup(FileSetup setup) { m_fileSetup = std::move(setup); }
+
+		std::future<Result> loadAsync(std::string path);
+		void loadAsync(std::string path, Completion completion);
+
+		// Loads submitted so far that have not started complete as cancelled. Loads in progress run to the end.
+		void cancel();
+
+		// Returns once every submitted load has completed. Not to be called from a completion.
+		void wait();
+
+	private:
+		struct Worker;
+
+		void submit(std::function<void()> task);
+		bool takeTask(size_t workerIndex, std::function<void()> &task);
+		void runWorker(size_t workerIndex);
+		void runLoad(const std::string &path, uint64_t generation, const Completion &completion);
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		size_t m_threadCount;
+		FileSetup m_fileSetup;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wakeup;
+		std::condition_variable m_idle;
+		size_t m_queued;
+		size_t m_outstanding;
+		bool m_stopping;
+
+		std::atomic<size_t> m_nextWorker;
+		std::atomic<uint64_t> m_generation;
+		std::atomic<uint64_t> m_cancelledGeneration;
+	};
+}
+
+#endif
@@ -1,12 +1,43 @@
 #ifndef NIFPARSE_NIFFILE_H
 #define NIFPARSE_NIFFILE_H
 
+#include <chrono>
 #include <iostream>
+#include <functional>
+#include <memory_resource>
+#include <unordered_map>
+#include <unordered_set>
 #include <nifparse/Types.h>
+#include <nifparse/TypedBlock.h>
 
 namespace nifparse {
+	class INIFDataStream;
+	class NIFVisitor;
+	class SerializerContext;
+	class TypePlanCache;
+
 	class NIFFile {
 	public:
+		/*
+		 * Runs task(0) .. task(taskCount - 1), possibly concurrently, and
+		 * returns once all of them have finished. Tasks do not throw.
+		 */
+		using BlockExecutor = std::function<void(size_t taskCount, const std::function<void(size_t index)> &task)>;
+
+		// Returns true for blocks that should not be read.
+		using BlockFilter = std::function<bool(Symbol type, size_t index)>;
+
+		// Block type to the fields that are read of its blocks.
+		using Projection = std::unordered_map<Symbol, std::unordered_set<Symbol>>;
+
+		struct ParseProgress {
+			size_t blocksRead;
+			size_t blockCount;
+
+			// Set when no incremental parse is in progress.
+			bool complete;
+		};
+
 		NIFFile();
 		~NIFFile();
 
@@ -14,6 +45,183 @@ namespace nifparse {
 		NIFFile &operator =(const NIFFile &other) = delete;
 
 		void parse(std::iostream &ins);
+		void parse(const char *filename);
+		void parse(const unsigned char *data, size_t dataSize);
+		void parse(INIFDataStream &stream);
+
+		/*
+		 * Incremental parsing, for callers that cannot block for a whole
+		 * parse(). beginParse() reads the header. Each parseNextBlocks() call
+		 * then takes at most the given number of steps, and parseFor() takes
+		 * steps until the time budget is used up, checking after each one. A
+		 * step reads one block; once all blocks are read, a step links one
+		 * block, and the last one reads the footer. Both return true once the
+		 * file is complete. Blocks are read in order on the calling thread, so
+		 * decodeThreads() and lazy decoding do not apply; visitors, projections
+		 * and the skip filter do. Blocks read so far are available from
+		 * block(), but are not linked until the end. The stream or the data
+		 * must stay valid until the parse is complete; files opened by name are
+		 * kept open until then, and with pipelined input are read ahead while
+		 * the caller does other work between steps. If a step throws, the parse
+		 * is abandoned.
+		 */
+		void beginParse(const char *filename);
+		void beginParse(const unsigned char *data, size_t dataSize);
+		void beginParse(INIFDataStream &stream);
+		bool parseNextBlocks(size_t count);
+		bool parseFor(std::chrono::steady_clock::duration budget);
+		ParseProgress parseProgress() const;
+
+		/*
+		 * When nifparse is built with NIFPARSE_NATIVE_CODEGEN, types are read by
+		 * the generated C++ code unless this is turned off, which makes the
+		 * bytecode interpreter available as a reference to compare against.
+		 */
+		inline bool useNativeCode() const { return m_useNativeCode; }
+		inline void setUseNativeCode(bool useNativeCode) { m_useNativeCode = useNativeCode; }
+
+		/*
+		 * Blocks of the types listed in NIFPARSE_TYPED_BLOCKS at build time are
+		 * read into the structs from <nifparse/TypedBlocks.h> when this is
+		 * turned on. They stay in the variant tree as empty dictionaries that
+		 * only carry the type chain, so references to them still resolve.
+		 */
+		inline bool useTypedBlocks() const { return m_useTypedBlocks; }
+		inline void setUseTypedBlocks(bool useTypedBlocks) { m_useTypedBlocks = useTypedBlocks; }
+
+		/*
+		 * Memory the parsed tree is allocated from. By default every NIFFile
+		 * owns a monotonic arena: parsing does not go through the global heap,
+		 * and the whole tree is released at once when the file is destroyed.
+		 * Values moved out of the tree and references to its blocks must then
+		 * not outlive the NIFFile; copies made outside of parse() are
+		 * allocated normally. Setting nullptr returns to the file's own arena.
+		 */
+		inline std::pmr::memory_resource *memoryResource() const { return m_memoryResource; }
+		void setMemoryResource(std::pmr::memory_resource *resource);
+
+		/*
+		 * Number of threads blocks are decoded on; 0 uses every hardware
+		 * thread. Decoding is only parallel for memory-backed streams, where
+		 * the offset of every block is known up front: from the Block Size
+		 * table of the header, or for Morrowind-era files by measuring the
+		 * blocks first, which reads little more than the fields that array
+		 * sizes and conditions depend on. Other streams are read in order as
+		 * with 1, the default. Linking and the footer are processed once all
+		 * blocks are read. Each decoding task allocates from an arena of its
+		 * own, or from the memory resource set above, which then must be
+		 * thread-safe.
+		 */
+		inline unsigned int decodeThreads() const { return m_decodeThreads; }
+		inline void setDecodeThreads(unsigned int decodeThreads) { m_decodeThreads = decodeThreads; }
+
+		/*
+		 * Runs the decoding tasks instead of the threads NIFFile starts on its
+		 * own, for example on an application's thread pool. Setting an empty
+		 * executor returns to the internal threads.
+		 */
+		inline const BlockExecutor &blockExecutor() const { return m_blockExecutor; }
+		inline void setBlockExecutor(BlockExecutor executor) { m_blockExecutor = std::move(executor); }
+
+		/*
+		 * With lazy decoding, parse() reads only the header and the footer, and
+		 * measures the blocks of Morrowind-era files to find where they start.
+		 * Every block is decoded the first time block(), resolve() or
+		 * typedBlock() reach it. This is thread-safe, and decoded blocks are
+		 * kept. References are not linked in this mode: their ptr stays empty,
+		 * so go through resolve() instead. The data given to parse() must stay
+		 * valid for as long as the NIFFile exists; files opened by name are
+		 * kept mapped. Streams that are not memory-backed, and files from
+		 * 5.0.0.1 to 20.2.0.6, which have block types but no block sizes in the
+		 * header, are decoded eagerly and linked as without lazy decoding.
+		 */
+		inline bool useLazyDecoding() const { return m_useLazyDecoding; }
+		inline void setUseLazyDecoding(bool useLazyDecoding) { m_useLazyDecoding = useLazyDecoding; }
+
+		/*
+		 * With pipelined input, files opened by name are read into a ring of
+		 * buffers by a thread of their own, ahead of decoding, instead of
+		 * being mapped, so that waiting for the disk overlaps with decoding
+		 * and only a bounded part of a large file is in memory at once. The
+		 * data is then not memory-backed: blocks are read in order, as with
+		 * decodeThreads() of 1. Lazy decoding needs the whole file, and maps
+		 * it regardless.
+		 */
+		inline bool usePipelinedInput() const { return m_usePipelinedInput; }
+		inline void setUsePipelinedInput(bool usePipelinedInput) { m_usePipelinedInput = usePipelinedInput; }
+
+		/*
+		 * Blocks the filter returns true for are passed over with a seek
+		 * instead of being read, provided that their size is known from the
+		 * header or, for Morrowind-era files, by measuring memory-backed data
+		 * as for parallel decoding. Like typed blocks, they stay in the variant
+		 * tree as empty dictionaries that only carry the type chain, so
+		 * references to them still resolve; blockSkipped() tells them apart.
+		 * With parallel or lazy decoding, the filter is called from several
+		 * threads.
+		 */
+		inline const BlockFilter &skipFilter() const { return m_skipFilter; }
+		inline void setSkipFilter(BlockFilter filter) { m_skipFilter = std::move(filter); }
+
+		// Skips the blocks of these types and of the types derived from them, such as bhkRefObject for all of the collision data.
+		void setSkipTypes(const std::unordered_set<Symbol> &types);
+
+		/*
+		 * Blocks of the types in the projection, and of the types derived from
+		 * them, are read with only the listed fields, including those the
+		 * block inherits, such as Name of NiObjectNET for NiNode. The entry of
+		 * the most derived type applies. Other fields are skipped, with a seek
+		 * where their size is fixed, and fields that later conditions or array
+		 * sizes depend on are read but not kept. Values of the kept fields are
+		 * complete. Projected blocks are always read by the bytecode
+		 * interpreter; typed blocks are not affected.
+		 */
+		inline const Projection &projection() const { return m_projection; }
+		inline void setProjection(Projection projection) { m_projection = std::move(projection); }
+
+		/*
+		 * With a visitor, parse() reports the fields of every block to it in
+		 * file order instead of building the blocks, keeping only the fields
+		 * that conditions and array sizes depend on while a block is read.
+		 * block() then returns nullptr for every block; the header, the footer
+		 * and blockType() are available as usual, and header() is already set
+		 * when the first block is visited. Blocks are read in order on the
+		 * calling thread, by the bytecode interpreter, and the projection and
+		 * the skip filter still apply, the latter only where block sizes are
+		 * in the header. Typed blocks are not used.
+		 */
+		inline NIFVisitor *visitor() const { return m_visitor; }
+		inline void setVisitor(NIFVisitor *visitor) { m_visitor = visitor; }
+
+		size_t blockCount() const;
+
+		// Known without decoding the block. Returns a null symbol if the block is out of range.
+		Symbol blockType(int32_t target) const;
+
+		// Returns nullptr if the block is out of range.
+		std::shared_ptr<NIFVariant> block(int32_t target) const;
+		std::shared_ptr<NIFVariant> resolve(const NIFReference &ref) const;
+		std::shared_ptr<NIFVariant> resolve(const NIFPointer &ptr) const;
+
+		bool blockSkipped(int32_t target) const;
+
+		// Returns nullptr if the block is out of range or was read into the variant tree.
+		TypedBlock *typedBlock(int32_t target) const;
+
+		template<typename T>
+		T *typedBlock(int32_t target) const {
+			return dynamic_cast<T *>(typedBlock(target));
+		}
+
+		template<typename T>
+		inline T *resolve(const TypedReference &ref) const {
+			return typedBlock<T>(ref.target);
+		}
+
+		template<typename T>
+		inline T *resolve(const TypedPointer &ptr) const {
+			return typedBlock<T>(ptr.target);
+		}
 
 		NIFDictionary &header();
 		const NIFDictionary &header() const;
@@ -22,6 +230,30 @@ namespace nifparse {
 		const NIFArray &rootObjects() const;
 
 	private:
+		struct BlockSpan {
+			size_t offset;
+			size_t size;
+		};
+
+		struct BlockIndex;
+		struct IncrementalParse;
+
+		size_t readHeader(SerializerContext &ctx);
+		const NIFVector<uint32_t> *headerBlockSizes() const;
+		void readNextBlock(SerializerContext &ctx, const NIFVector<uint32_t> *blockSizes);
+		void readFooter(SerializerContext &ctx);
+		bool parseStep();
+
+		std::shared_ptr<NIFVariant> readBlock(SerializerContext &ctx, Symbol blockType, size_t index, std::shared_ptr<TypedBlock> &typedBlock) const;
+		bool skipBlock(Symbol blockType, size_t index) const;
+		const std::unordered_set<Symbol> *projectedFields(Symbol blockType) const;
+		std::shared_ptr<NIFVariant> skippedBlock(Symbol blockType) const;
+		std::shared_ptr<NIFVariant> readBlockAt(const unsigned char *data, size_t dataSize, const BlockSpan &span, size_t index, TypePlanCache &plans,
+			std::shared_ptr<TypedBlock> &typedBlock) const;
+		void readBlocksOutOfOrder(const unsigned char *data, size_t dataSize, std::vector<BlockSpan> &&spans, TypePlanCache &plans);
+		void readBlocksParallel(const unsigned char *data, size_t dataSize, const std::vector<BlockSpan> &spans, TypePlanCache &plans);
+		void indexBlocks(const unsigned char *data, size_t dataSize, std::vector<BlockSpan> &&spans, TypePlanCache &plans);
+		void decodeBlock(size_t index) const;
 		void linkBlock(NIFVariant &value);
 		inline void doLinkBlock(std::monostate) { }
 		inline void doLinkBlock(uint32_t) { }
@@ -29,15 +261,42 @@ namespace nifparse {
 		void doLinkBlock(NIFArray &arr);
 		inline void doLinkBlock(NIFEnum &) { }
 		inline void doLinkBlock(NIFBitflags &) { }
-		inline void doLinkBlock(std::vector<unsigned char> &) { }
-		inline void doLinkBlock(std::string &) { }
+		inline void doLinkBlock(NIFVector<unsigned char> &) { }
+		inline void doLinkBlock(NIFString &) { }
 		void doLinkBlock(NIFReference &);
 		void doLinkBlock(NIFPointer &);
 		inline void doLinkBlock(float) { }
+		inline void doLinkBlock(NIFVector<uint16_t> &) { }
+		inline void doLinkBlock(NIFVector<int16_t> &) { }
+		inline void doLinkBlock(NIFVector<uint32_t> &) { }
+		inline void doLinkBlock(NIFVector<float> &) { }
+		inline void doLinkBlock(NIFStructArray &) { }
+
+		// Declared first, so that it is destroyed after everything allocated from it.
+		std::pmr::monotonic_buffer_resource m_arena;
+		std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> m_taskArenas;
+		std::unique_ptr<BlockIndex> m_blockIndex;
+		std::unique_ptr<IncrementalParse> m_incremental;
+		std::pmr::memory_resource *m_memoryResource;
 
 		NIFVariant m_header;
-		std::vector<std::shared_ptr<NIFVariant>> m_blocks;
+		std::vector<Symbol> m_blockTypes;
+
+		// Filled in by decodeBlock() with lazy decoding.
+		mutable std::vector<std::shared_ptr<NIFVariant>> m_blocks;
+		mutable std::vector<std::shared_ptr<TypedBlock>> m_typedBlocks;
+		// Not vector<bool>, which blocks decoded on different threads could not set independently.
+		mutable std::vector<uint8_t> m_skippedBlocks;
 		NIFVariant m_footer;
+		bool m_useNativeCode;
+		bool m_useTypedBlocks;
+		bool m_useLazyDecoding;
+		bool m_usePipelinedInput;
+		unsigned int m_decodeThreads;
+		BlockExecutor m_blockExecutor;
+		BlockFilter m_skipFilter;
+		Projection m_projection;
+		NIFVisitor *m_visitor;
 	};
 }
 
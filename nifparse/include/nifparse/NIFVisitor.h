@@ -0,0 +1,48 @@
+#ifndef NIFPARSE_NIF_VISITOR_H
+#define NIFPARSE_NIF_VISITOR_H
+
+#include <nifparse/Types.h>
+
+namespace nifparse {
+	/*
+	 * Receives the values of blocks as they are read, instead of a tree being
+	 * built; see NIFFile::setVisitor. Fields are reported in file order, with
+	 * the names of inherited fields first. Values without a name are elements
+	 * of the array being visited. Arguments are only valid during the call.
+	 */
+	class NIFVisitor {
+	public:
+		NIFVisitor();
+		virtual ~NIFVisitor();
+
+		NIFVisitor(const NIFVisitor &other) = delete;
+		NIFVisitor &operator =(const NIFVisitor &other) = delete;
+
+		virtual void beginBlock(Symbol type, size_t index);
+		virtual void endBlock();
+
+		virtual void beginCompound(Symbol name, Symbol type);
+		virtual void endCompound();
+
+		// Arrays that are not packed.
+		virtual void beginArray(Symbol name, size_t length);
+		virtual void endArray();
+
+		// A uint32_t, float, NIFEnum or NIFBitflags.
+		virtual void scalar(Symbol name, const NIFVariant &value);
+
+		// Arrays of bytes and chars.
+		virtual void bytes(Symbol name, const unsigned char *data, size_t size);
+
+		// Any other packed array: a NIFVector of a basic type or a NIFStructArray.
+		virtual void packedArray(Symbol name, const NIFVariant &array);
+
+		virtual void reference(Symbol name, Symbol type, int32_t target);
+		virtual void pointer(Symbol name, Symbol type, int32_t target);
+
+		// Reports a value that is already built, as the callbacks above.
+		void visitValue(Symbol name, const NIFVariant &value);
+	};
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef NIFPARSE_NATIVE_DESERIALIZER_H
+#define NIFPARSE_NATIVE_DESERIALIZER_H
+
+#include <nifparse/Types.h>
+#include <nifparse/SerializerContext.h>
+#include <nifparse/TypeDescription.h>
+#include <nifparse/ConstantDataStream.h>
+
+namespace nifparse {
+	/*
+	 * Runtime support for the C++ deserializers generated from nif.xml by
+	 * generator/generate_native. Every helper here mirrors what the bytecode
+	 * interpreter does for the corresponding opcode, so that both produce
+	 * identical trees.
+	 */
+	class NativeDeserializer {
+	public:
+		struct Entry {
+			Symbol type;
+			NativeDeserializerFunction function;
+		};
+
+		NativeDeserializer() = delete;
+
+		static NativeDeserializerFunction find(Symbol type);
+
+		static NIFDictionary &beginCompound(SerializerContext &ctx, NIFVariant &value, Symbol type);
+
+		static inline void setField(NIFDictionary &dictionary, Symbol name, NIFVariant &&value) {
+			auto result = dictionary.data.try_emplace(name, std::move(value));
+			if (!result.second) {
+				result.first->second = std::move(value);
+			}
+		}
+
+		static inline NIFVariant readNamed(SerializerContext &ctx, NativeDeserializerFunction function, uint32_t arg, const TypeDescription *specialization) {
+			NIFVariant value;
+			function(ctx, value, arg, specialization);
+			return value;
+		}
+
+		// Reads an innermost array dimension the same way TypeDescription does, as a NIFStructArray if the type has a fixed layout.
+		static NIFVariant readNamedArray(SerializerContext &ctx, NativeDeserializerFunction function, Symbol type, uint32_t size, uint32_t arg, const TypeDescription *specialization);
+
+		static NIFReference readReference(SerializerContext &ctx, Symbol type);
+		static NIFPointer readPointer(SerializerContext &ctx, Symbol type);
+
+		static const TypeDescription &templateArgument(const TypeDescription *specialization);
+		static Symbol templateTypeName(const TypeDescription *specialization);
+		static NIFVariant readTemplate(SerializerContext &ctx, const TypeDescription *specialization, uint32_t arg);
+
+		template<typename Reader>
+		static auto readDefault(SerializerContext &ctx, const unsigned char *data, size_t dataSize, Reader reader) {
+			ConstantDataStream defaultStream(data, dataSize);
+			SerializerContext defaultContext(ctx.header, defaultStream, true);
+			defaultContext.setPlans(ctx.plans());
+			defaultContext.setUseNativeCode(ctx.useNativeCode());
+			return reader(defaultContext);
+		}
+
+		static uint32_t value(const NIFDictionary &dictionary, Symbol name);
+		static StackValue stackValue(const NIFDictionary &dictionary, Symbol name);
+		static const NIFDictionary &indirect(const NIFDictionary &dictionary, Symbol name);
+
+		// Size of an array dimension given by a single field, which may be a per-row array for jagged arrays.
+		static uint32_t dimension(const NIFDictionary &dictionary, Symbol name, uint32_t outerIndex = static_cast<uint32_t>(~0));
+
+		static uint32_t headerField(SerializerContext &ctx, Symbol name, Symbol fallbackName = Symbol());
+		static uint32_t version(SerializerContext &ctx);
+		static uint32_t userVersion(SerializerContext &ctx);
+		static uint32_t userVersion2(SerializerContext &ctx);
+
+	private:
+		// Provided by the generated code.
+		static const Entry m_entries[];
+		static const size_t m_entryCount;
+	};
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NIFPARSE_PLAN_VERSION_H
+#define NIFPARSE_PLAN_VERSION_H
+
+#include <nifparse/Types.h>
+
+namespace nifparse {
+	/*
+	 * The header fields that version conditions in type bytecode test.
+	 * Fields missing from the header are left to be evaluated at run time.
+	 */
+	struct PlanVersion {
+		enum : uint32_t {
+			HasVersion = 1 << 0,
+			HasUserVersion = 1 << 1,
+			HasUserVersion2 = 1 << 2
+		};
+
+		uint32_t presentFields;
+		uint32_t version;
+		uint32_t userVersion;
+		uint32_t userVersion2;
+
+		PlanVersion();
+
+		bool headerField(Symbol field, uint32_t &value) const;
+
+		bool operator <(const PlanVersion &other) const;
+
+		static PlanVersion fromHeader(const NIFDictionary &header);
+	};
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef NIFPARSE_PREFETCHING_FILE_DATA_STREAM_H
+#define NIFPARSE_PREFETCHING_FILE_DATA_STREAM_H
+
+#include <nifparse/INIFDataStream.h>
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace nifparse {
+	/*
+	 * Reads a file on a thread of its own into a ring of buffers, ahead of
+	 * the position the stream is read from, so that waiting for the disk
+	 * overlaps with decoding. Only the ring is in memory, however large the
+	 * file is. Reading on is cheap; seeking back before the current buffer,
+	 * or past what has been read ahead, restarts the reading at the new
+	 * position.
+	 */
+	class PrefetchingFileDataStream final : public INIFDataStream {
+	public:
+		explicit PrefetchingFileDataStream(const char *filename, size_t bufferSize = 4 * 1024 * 1024, size_t bufferCount = 4);
+		~PrefetchingFileDataStream();
+
+		virtual void readBytes(unsigned char *bytes, size_t size) override;
+		virtual void writeBytes(const unsigned char *bytes, size_t size) override;
+		virtual size_t position() const override;
+		virtual void seek(size_t position) override;
+		virtual const unsigned char *window(size_t &size) override;
+		virtual bool windowCoversStream() const override;
+
+		inline size_t size() const { return m_size; }
+
+	private:
+		const unsigned char *acquireBuffer(size_t buffer);
+		void runReader();
+		void readAt(size_t offset, unsigned char *data, size_t size);
+		void close();
+
+		std::string m_filename;
+		size_t m_size;
+		size_t m_bufferSize;
+		size_t m_bufferCount;
+		std::unique_ptr<unsigned char[]> m_buffers;
+		size_t m_position;
+
+		std::mutex m_mutex;
+		std::condition_variable m_readerWakeup;
+		std::condition_variable m_bufferReady;
+
+		// Buffers from m_firstBuffer up to m_nextBuffer are filled, and the reader fills m_nextBuffer while it is less than m_bufferCount ahead.
+		size_t m_firstBuffer;
+		size_t m_nextBuffer;
+		uint64_t m_generation;
+		std::exception_ptr m_error;
+		bool m_stopping;
+
+#ifdef _WIN32
+		void *m_file;
+#else
+		int m_fd;
+#endif
+
+		std::thread m_reader;
+	};
+}
+
+#endif
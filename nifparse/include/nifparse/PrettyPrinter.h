@@ -23,11 +23,19 @@ namespace nifparse {
 		void doPrint(const NIFArray &ary);
 		void doPrint(const NIFEnum &val);
 		void doPrint(const NIFBitflags &val);
-		void doPrint(const std::vector<unsigned char> &byteArray);
-		void doPrint(const std::string &string);
+		void doPrint(const NIFVector<unsigned char> &byteArray);
+		void doPrint(const NIFString &string);
 		void doPrint(const NIFReference &ref);
 		void doPrint(const NIFPointer &ptr);
 		void doPrint(float val);
+		void doPrint(const NIFVector<uint16_t> &ary);
+		void doPrint(const NIFVector<int16_t> &ary);
+		void doPrint(const NIFVector<uint32_t> &ary);
+		void doPrint(const NIFVector<float> &ary);
+		void doPrint(const NIFStructArray &ary);
+
+		template<typename T>
+		void printPackedArray(const NIFVector<T> &ary);
 
 		void printKey(const char *key);
 		void printValue(const char *value);
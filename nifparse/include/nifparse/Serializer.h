@@ -2,20 +2,29 @@
 #define NIFPARSE_SERIALIZER_H
 
 #include <nifparse/Types.h>
-#include <nifparse/BytecodeReader.h>
+
+#include <unordered_set>
 
 namespace nifparse {
+	class NIFVisitor;
 	class SerializerContext;
 	class TypeDescription;
+	class TypePlan;
 
 	class Serializer {
 	public:
 		enum class Mode {
 			Serialize,
-			Deserialize
+			Deserialize,
+
+			// Reads only the fields that conditions and array sizes depend on, and skips over the rest.
+			Measure,
+
+			// Reports fields to a NIFVisitor as they are read, keeping only those that conditions and array sizes depend on.
+			Visit
 		};
 
-		Serializer(Mode mode, Symbol typeSymbol, NIFVariant &value);
+		Serializer(Mode mode, const TypePlan &plan, NIFVariant &value);
 		~Serializer();
 
 		Serializer(const Serializer &other) = delete;
@@ -26,27 +35,63 @@ namespace nifparse {
 		static void serialize(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value);
 		static void deserialize(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value);
 
+		// Advances the context past a value of the type without building it.
+		static void measure(SerializerContext &ctx, Symbol typeSymbol);
+
+		/*
+		 * Deserializes only the listed fields of a compound and of the types it
+		 * inherits. Fields that conditions and array sizes depend on are read
+		 * as well, but removed once the value is complete; the others are
+		 * skipped. Always runs the bytecode interpreter.
+		 */
+		static void project(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value, const std::unordered_set<Symbol> &fields);
+
+		// Reports the fields of a compound to the visitor, or only those listed if fields is not null. Always runs the bytecode interpreter.
+		static void visit(SerializerContext &ctx, Symbol typeSymbol, NIFVisitor &visitor, const std::unordered_set<Symbol> *fields = nullptr);
+
+		static uint32_t evaluateUnary(Opcode op, uint32_t value);
+		static uint32_t evaluateBinary(Opcode op, uint32_t left, uint32_t right);
+
+		/*
+		 * Instructions the interpreter has executed on the calling thread, for
+		 * benchmarking dispatch. Only counted when nifparse is built with
+		 * NIFPARSE_INTERPRETER_STATS, otherwise 0.
+		 */
+		static uint64_t executedInstructions();
+
 		inline uint32_t arg() const { return m_arg; }
 		inline void setArg(uint32_t arg) { m_arg = arg; }
 
-		inline TypeDescription *specialization() const { return m_specialization; }
-		inline void setSpecialization(TypeDescription *specialization) { m_specialization = specialization; }
+		inline const TypeDescription *specialization() const { return m_specialization; }
+		inline void setSpecialization(const TypeDescription *specialization) { m_specialization = specialization; }
+
+		// Fields to deserialize, or nullptr for all of them. See project().
+		inline const std::unordered_set<Symbol> *projection() const { return m_projection; }
+		inline void setProjection(const std::unordered_set<Symbol> *projection) { m_projection = projection; }
+
+		inline NIFVisitor *visitor() const { return m_visitor; }
+		inline void setVisitor(NIFVisitor *visitor) { m_visitor = visitor; }
 
 	private:
 		void executeCompound(SerializerContext &ctx);
-		void executeEnum(SerializerContext &ctx, Opcode startOpcode);
+		void executeEnum(SerializerContext &ctx);
 		void doExecuteCompound(SerializerContext &ctx, NIFDictionary &dictionary);
-		void executeUnary(Opcode op);
-		void executeBinary(Opcode op);
 		StackValue coerceForStack(const NIFVariant &value);
+		uint32_t numberForStack(Symbol fieldName, const NIFVariant &value);
+		bool retainsField(Symbol name) const;
+		bool readsField(Symbol name) const;
+		bool reportsField(Symbol name) const;
 
 		Mode m_mode;
-		Symbol m_type;
-		BytecodeReader m_bytecodeReader;
+		const TypePlan &m_plan;
 		NIFVariant &m_value;
-		std::vector<StackValue> m_stack;
 		uint32_t m_arg;
-		TypeDescription *m_specialization;
+		const TypeDescription *m_specialization;
+		const std::unordered_set<Symbol> *m_projection;
+		NIFVisitor *m_visitor;
+
+		// When measuring, projecting or visiting an inherited type, the serializer of the derived type, whose fields have to be kept as well.
+		const Serializer *m_derived;
 	};
 }
 
@@ -2,10 +2,16 @@
 #define NIFPARSE_SERIALIZER_CONTEXT_H
 
 #include <iostream>
+#include <string.h>
 #include <nifparse/Types.h>
 
 namespace nifparse {
 	class INIFDataStream;
+	class SerializerContext;
+	class TypePlanCache;
+	class TypeDescription;
+
+	using NativeDeserializerFunction = void (*)(SerializerContext &ctx, NIFVariant &value, uint32_t arg, const TypeDescription *specialization);
 
 	class SerializerContext {
 	public:
@@ -15,14 +21,73 @@ namespace nifparse {
 		SerializerContext(const SerializerContext &other) = delete;
 		SerializerContext &operator =(const SerializerContext &other) = delete;
 
-		inline INIFDataStream &stream() { return m_stream; }
 		inline bool useConstantLengths() const { return m_useConstantLengths; }
 
+		inline TypePlanCache &plans() const { return *m_plans; }
+		inline void setPlans(TypePlanCache &plans) { m_plans = &plans; }
+
+		inline bool useNativeCode() const { return m_useNativeCode; }
+		inline void setUseNativeCode(bool useNativeCode) { m_useNativeCode = useNativeCode; }
+
+		// Returns the generated deserializer for the type, or nullptr if the bytecode should be used.
+		NativeDeserializerFunction nativeDeserializer(Symbol type) const;
+
+		inline void readBytes(unsigned char *bytes, size_t size) {
+			if (size <= static_cast<size_t>(m_end - m_cursor)) {
+				memcpy(bytes, m_cursor, size);
+				m_cursor += size;
+			}
+			else {
+				readBytesSlow(bytes, size);
+			}
+		}
+
+		inline void skipBytes(size_t size) {
+			if (size <= static_cast<size_t>(m_end - m_cursor)) {
+				m_cursor += size;
+			}
+			else {
+				seek(position() + size);
+			}
+		}
+
+		template<typename T>
+		inline T read() {
+			T value;
+			readBytes(reinterpret_cast<unsigned char *>(&value), sizeof(value));
+			return value;
+		}
+
+		size_t position() const;
+		void seek(size_t position);
+
+		// The rest of the data from the current position if all of it is in memory, or nullptr otherwise.
+		inline const unsigned char *remainingData(size_t &size) const {
+			if (!m_windowCoversStream) {
+				size = 0;
+				return nullptr;
+			}
+
+			size = m_end - m_cursor;
+			return m_cursor;
+		}
+
 		NIFVariant &header;
 
 	private:
+		void readBytesSlow(unsigned char *bytes, size_t size);
+		void acquireWindow();
+		void sync();
+
 		INIFDataStream &m_stream;
 		bool m_useConstantLengths;
+		TypePlanCache *m_plans;
+		bool m_useNativeCode;
+		const unsigned char *m_windowBegin;
+		const unsigned char *m_cursor;
+		const unsigned char *m_end;
+		size_t m_windowPosition;
+		bool m_windowCoversStream;
 	};
 }
 
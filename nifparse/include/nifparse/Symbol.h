@@ -2,6 +2,8 @@
 #define NIFPARSE_SYMBOL_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <functional>
 #include <utility>
 
 namespace nifparse {
@@ -34,6 +36,8 @@ namespace nifparse {
 
 		Symbol parentType() const;
 
+		static size_t count();
+
 	private:
 		uint32_t m_value;
 
@@ -2,14 +2,20 @@
 #define NIFPARSE_SYMBOLTABLE_H
 
 #include <stdint.h>
-#include <unordered_map>
+#include <stddef.h>
 #include <nifparse/Symbol.h>
 
 namespace nifparse {
+	/*
+	 * Reads the symbol tables that generate_bytecode emits along with the
+	 * bytecode. They are constant data, so the table has no state and needs
+	 * no initialization, and symbols can be looked up from any static
+	 * initializer.
+	 */
 	class SymbolTable {
 	public:
-		SymbolTable();
-		~SymbolTable();
+		SymbolTable() = default;
+		~SymbolTable() = default;
 
 		SymbolTable(const SymbolTable &other) = delete;
 		SymbolTable &operator =(const SymbolTable &other) = delete;
@@ -18,21 +24,10 @@ namespace nifparse {
 		const char *symbolToString(uint32_t value) const;
 		size_t bytecodeStartOffset(const Symbol &symbol) const;
 		bool isTypeName(const Symbol &symbol) const;
+		size_t symbolCount() const;
 
-	private:
-		struct SymbolLookupHash {
-			size_t operator()(const char *string) const;
-		};
-
-		struct SymbolLookupEqual {
-			bool operator()(const char *string1, const char *string2) const;
-		};
-
-		std::unordered_map<Symbol, uint32_t> m_typeOffsetMap;
-		std::vector<const char *> m_symbolStrings;
-		std::unordered_map<const char *, uint32_t, SymbolLookupHash, SymbolLookupEqual> m_symbolLookup;
-
-		size_t m_bytecodeStartOffset;
+		// Must match symbol_hash in generate_bytecode.
+		static uint32_t hashString(uint32_t seed, const char *string);
 	};
 }
 
@@ -5,15 +5,17 @@
 
 namespace nifparse {
 	class BytecodeReader;
+	class NIFVisitor;
 	class SerializerContext;
 
+	/*
+	 * Describes the type of a field as it is read, including its array
+	 * dimensions. Descriptions do not allocate: dimensions are kept inline,
+	 * and the template argument of a specialized type such as Ref<NiNode> or
+	 * KeyGroup<float> is a pointer to a description that outlives this one,
+	 * either held by a TypePlan or interned for the rest of the process.
+	 */
 	class TypeDescription {
-		enum SpecializationMarker {
-			Specialization
-		};
-
-		TypeDescription(SpecializationMarker);
-
 	public:
 		enum class Type {
 			Null,
@@ -38,40 +40,76 @@ namespace nifparse {
 		};
 
 		TypeDescription();
+		explicit TypeDescription(Type type, Symbol typeName = Symbol());
 		~TypeDescription();
 
 		TypeDescription(const TypeDescription &other);
 		TypeDescription &operator =(const TypeDescription &other);
 
+		// Fields have at most two array dimensions.
+		static const size_t MaxDimensions = 2;
+
 		bool parse(Opcode opcode, BytecodeReader &bytecode);
+		// An array given as a dimension is referred to, not copied, and must stay in place until the value is read or written.
 		void addArrayDimension(StackValue dimension);
 		void reset();
 
-		NIFVariant readValue(SerializerContext &ctx);
-		void writeValue(SerializerContext &ctx, const NIFVariant &value);
+		NIFVariant readValue(SerializerContext &ctx) const;
+
+		// Advances past a value without building it, seeking over runs of fixed-size elements.
+		void skipValue(SerializerContext &ctx) const;
+
+		// Reports a value to the visitor while reading it, building only packed arrays and the fields of compounds that conditions need.
+		void visitValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name) const;
+
+		// Size of one element if it does not depend on the data, otherwise 0.
+		size_t fixedSize(SerializerContext &ctx) const;
+		void writeValue(SerializerContext &ctx, const NIFVariant &value) const;
 
 		inline const Type type() const { return m_type; }
 		inline Symbol typeName() const { return m_typeName; }
 		
-		inline TypeDescription &specialization() { return *m_specialization; }
+		// The template argument, or nullptr if the type is not specialized.
+		inline const TypeDescription *specialization() const { return m_specialization; }
+		inline void setSpecialization(const TypeDescription *specialization) { m_specialization = specialization; }
 
 		inline void setArg(uint32_t arg) { m_arg = arg; }
 
-		inline void setIsTemplate() { m_isTemplate = true; }
+		// Returns a copy of a description without array dimensions that stays in place until the process exits; equal descriptions share the copy.
+		static const TypeDescription *intern(const TypeDescription &description);
+
+		static uint32_t readBool(SerializerContext &ctx);
+		static uint32_t readHeaderString(SerializerContext &ctx);
+		static float readHalfFloat(SerializerContext &ctx);
+
+		// Innermost array dimensions of these types are read into packed vectors instead of NIFArray.
+		static bool isPackedArrayType(Type type);
+		static NIFVariant readPackedArray(SerializerContext &ctx, Type type, size_t size);
+
+		// Innermost array dimensions of compounds with a fixed layout are read as one block.
+		static NIFStructArray readStructArray(SerializerContext &ctx, const std::shared_ptr<const NIFStructLayout> &layout, size_t size);
 
 	private:
-		NIFVariant doReadValue(SerializerContext &ctx, uint32_t outerIndex, std::vector<StackValue>::iterator it);
-		NIFVariant readSingleValue(SerializerContext &ctx);
+		NIFVariant doReadValue(SerializerContext &ctx, uint32_t outerIndex, const StackValue *it) const;
+		NIFVariant readSingleValue(SerializerContext &ctx) const;
+
+		void doSkipValue(SerializerContext &ctx, uint32_t outerIndex, const StackValue *it) const;
+		void skipSingleValue(SerializerContext &ctx) const;
+
+		void doVisitValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name, uint32_t outerIndex, const StackValue *it) const;
+		void visitSingleValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name) const;
+
+		void doWriteValue(SerializerContext &ctx, const NIFVariant &value, uint32_t outerIndex, const StackValue *it) const;
+		void writeSingleValue(SerializerContext &ctx, const NIFVariant &value) const;
 
-		void doWriteValue(SerializerContext &ctx, const NIFVariant &value, uint32_t outerIndex, std::vector<StackValue>::iterator it);
-		void writeSingleValue(SerializerContext &ctx, const NIFVariant &value);
+		inline const StackValue *dimensionsEnd() const { return m_dimensions + m_dimensionCount; }
 
 		Type m_type;
-		std::vector<StackValue> m_dimensions;
+		StackValue m_dimensions[MaxDimensions];
+		size_t m_dimensionCount;
 		Symbol m_typeName;
 		uint32_t m_arg;
-		std::unique_ptr<TypeDescription> m_specialization;
-		bool m_isTemplate;
+		const TypeDescription *m_specialization;
 	};
 }
 
@@ -0,0 +1,121 @@
+#ifndef NIFPARSE_TYPE_PLAN_H
+#define NIFPARSE_TYPE_PLAN_H
+
+#include <nifparse/Types.h>
+#include <nifparse/TypeDescription.h>
+
+namespace nifparse {
+	class BytecodeReader;
+	class TypePlanCache;
+	struct PlanVersion;
+
+	/*
+	 * Type bytecode decoded once into a flat instruction list: operands are
+	 * pre-decoded, field types are pre-built TypeDescriptions and branches
+	 * refer to instruction indices rather than byte displacements.
+	 */
+	class TypePlan {
+	public:
+		enum class Kind {
+			Compound,
+			Enum,
+			Bitflags
+		};
+
+		struct Instruction {
+			Opcode opcode;
+			uint32_t operand;
+			uint32_t operand2;
+		};
+
+		struct DefaultValue {
+			const unsigned char *data;
+			size_t length;
+		};
+
+		struct Option {
+			Symbol name;
+			uint32_t value;
+		};
+
+		explicit TypePlan(Symbol type);
+
+		// Copies a generic plan and specializes it for one file version.
+		TypePlan(const TypePlan &generic, const PlanVersion &version);
+		~TypePlan();
+
+		TypePlan(const TypePlan &other) = delete;
+		TypePlan &operator =(const TypePlan &other) = delete;
+
+		inline Symbol type() const { return m_type; }
+		inline Kind kind() const { return m_kind; }
+
+		inline const std::vector<Instruction> &instructions() const { return m_instructions; }
+		inline const TypeDescription &typeDescription(uint32_t index) const { return m_typeDescriptions[index]; }
+		inline const DefaultValue &defaultValue(uint32_t index) const { return m_defaultValues[index]; }
+
+		inline const TypeDescription &storageType() const { return m_typeDescriptions.front(); }
+		inline const std::vector<Option> &options() const { return m_options; }
+
+		inline Symbol inheritedType() const { return m_inheritedType; }
+
+		// Slots of the dictionaries deserialized by this plan. Built by TypePlanCache once the inherited plan is available.
+		inline const std::shared_ptr<const NIFFieldLayout> &fieldLayout() const { return m_fieldLayout; }
+		void buildFieldLayout(const NIFFieldLayout *inheritedLayout);
+
+		// Set if every value of the type has the same layout, so that arrays of it can be stored as a NIFStructArray.
+		inline const std::shared_ptr<const NIFStructLayout> &structLayout() const { return m_structLayout; }
+
+		/*
+		 * Number of bytes every value of the type occupies in the file, or 0 if
+		 * it depends on the data. Only plans specialized for a file version are
+		 * likely to have one, as version conditions are otherwise left in place.
+		 */
+		inline size_t fixedSize() const { return m_fixedSize; }
+
+		// Computes the fixed size and struct layout. Called by TypePlanCache, which provides the plans of field types.
+		void analyzeSize(TypePlanCache &plans);
+
+		// Fields that the plan's own conditions and array sizes read. Measuring keeps only these and skips the rest.
+		inline const std::vector<Symbol> &referencedFields() const { return m_referencedFields; }
+
+		// The interpreter's operand stack has room for this many values; deeper plans are rejected when compiled.
+		static const size_t MaxStackDepth = 16;
+
+		/*
+		 * Most values the plan's expressions keep on the operand stack at
+		 * once. Plans are verified as they are compiled and specialized:
+		 * branches only lead forward, so a single pass finds the depth, and
+		 * rejects instructions that could underflow the stack, take an array
+		 * where a number is needed, or refer to types and default values that
+		 * do not exist. The interpreter relies on this and does not check
+		 * again.
+		 */
+		inline size_t stackDepth() const { return m_stackDepth; }
+
+		static void stackEffect(Opcode op, unsigned int &pops, unsigned int &pushes);
+
+	private:
+		void compileCompound(BytecodeReader &reader);
+		void compileEnum(BytecodeReader &reader);
+		static TypeDescription parseTypeDescription(Opcode opcode, BytecodeReader &reader);
+		uint32_t addTypeDescription(Opcode opcode, BytecodeReader &reader);
+		void computeReferencedFields();
+		void verify();
+
+		Symbol m_type;
+		Kind m_kind;
+		std::vector<Instruction> m_instructions;
+		std::vector<TypeDescription> m_typeDescriptions;
+		std::vector<DefaultValue> m_defaultValues;
+		std::vector<Option> m_options;
+		Symbol m_inheritedType;
+		std::shared_ptr<const NIFFieldLayout> m_fieldLayout;
+		std::shared_ptr<const NIFStructLayout> m_structLayout;
+		size_t m_fixedSize;
+		std::vector<Symbol> m_referencedFields;
+		size_t m_stackDepth;
+	};
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef NIFPARSE_TYPE_PLAN_CACHE_H
+#define NIFPARSE_TYPE_PLAN_CACHE_H
+
+#include <nifparse/Symbol.h>
+#include <nifparse/PlanVersion.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nifparse {
+	class TypePlan;
+
+	class TypePlanCache {
+	public:
+		TypePlanCache();
+		explicit TypePlanCache(const PlanVersion &version);
+		~TypePlanCache();
+
+		TypePlanCache(const TypePlanCache &other) = delete;
+		TypePlanCache &operator =(const TypePlanCache &other) = delete;
+
+		inline const TypePlan &plan(Symbol type) {
+			if (static_cast<uint32_t>(type) < m_symbolCount) {
+				auto plan = m_plans[type].load(std::memory_order_acquire);
+				if (plan)
+					return *plan;
+			}
+
+			return compile(type);
+		}
+
+		// Size of every value of the type for this version, or 0 if it varies. See TypePlan::fixedSize.
+		size_t fixedSize(Symbol type);
+
+		inline bool isSpecialized() const { return m_specialized; }
+		inline const PlanVersion &version() const { return m_version; }
+
+		static TypePlanCache &instance();
+
+		// Plans specialized for one file version, shared by every file of that version.
+		static TypePlanCache &forVersion(const PlanVersion &version);
+
+	private:
+		const TypePlan &compile(Symbol type);
+
+		bool m_specialized;
+		PlanVersion m_version;
+		size_t m_symbolCount;
+		std::unique_ptr<std::atomic<const TypePlan *>[]> m_plans;
+		std::vector<std::unique_ptr<TypePlan>> m_compiledPlans;
+		std::mutex m_compileMutex;
+	};
+}
+
+#endif
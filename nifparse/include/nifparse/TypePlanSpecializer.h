@@ -0,0 +1,51 @@
+#ifndef NIFPARSE_TYPE_PLAN_SPECIALIZER_H
+#define NIFPARSE_TYPE_PLAN_SPECIALIZER_H
+
+#include <nifparse/TypePlan.h>
+#include <nifparse/PlanVersion.h>
+
+namespace nifparse {
+	/*
+	 * Partially evaluates a compound type plan for one file version: header
+	 * fields are replaced with their values, constant conditions are folded,
+	 * and fields that can never be present are dropped along with their
+	 * type setup. Runs peephole rules over basic blocks until nothing
+	 * changes, then compacts the instruction list.
+	 */
+	class TypePlanSpecializer {
+	public:
+		TypePlanSpecializer(std::vector<TypePlan::Instruction> &instructions, const PlanVersion &version);
+		~TypePlanSpecializer();
+
+		TypePlanSpecializer(const TypePlanSpecializer &other) = delete;
+		TypePlanSpecializer &operator =(const TypePlanSpecializer &other) = delete;
+
+		void run();
+
+	private:
+		static const size_t NotFound = ~static_cast<size_t>(0);
+
+		static bool isControlFlow(Opcode op);
+
+		void findBranchTargets();
+		bool foldInstruction(size_t index);
+		bool foldCondition(size_t index, size_t producer);
+		bool foldLogical(size_t index, size_t left, size_t right);
+		bool removeUnreachable();
+		void removeFieldSetup(size_t field);
+		void compact();
+
+		size_t findProducer(size_t consumer, unsigned int depth) const;
+		size_t nextLive(size_t index) const;
+		bool isLiteral(size_t index) const;
+		bool producesBoolean(size_t index) const;
+		void remove(size_t index);
+		void replaceWithLiteral(size_t index, uint32_t value);
+
+		std::vector<TypePlan::Instruction> &m_instructions;
+		const PlanVersion &m_version;
+		std::vector<bool> m_branchTargets;
+	};
+}
+
+#endif
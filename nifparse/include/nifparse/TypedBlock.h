@@ -0,0 +1,51 @@
+#ifndef NIFPARSE_TYPED_BLOCK_H
+#define NIFPARSE_TYPED_BLOCK_H
+
+#include <nifparse/Types.h>
+
+namespace nifparse {
+	class SerializerContext;
+
+	// References inside typed blocks are block indices; resolve them with NIFFile::typedBlock.
+	struct TypedReference {
+		int32_t target = -1;
+	};
+
+	struct TypedPointer {
+		int32_t target = -1;
+	};
+
+	/*
+	 * Base of the structs that generator/generate_structs emits into
+	 * <nifparse/TypedBlocks.h> for the block types listed in
+	 * NIFPARSE_TYPED_BLOCKS.
+	 */
+	struct TypedBlock {
+		virtual ~TypedBlock();
+
+		Symbol blockType;
+	};
+
+	// Reads a block into its struct, and fills in the placeholder that stands for it in the variant tree.
+	using TypedBlockFunction = std::shared_ptr<TypedBlock> (*)(SerializerContext &ctx, NIFDictionary &placeholder);
+
+	class TypedBlockReader {
+	public:
+		TypedBlockReader() = delete;
+
+		// Returns nullptr for block types that were not selected at build time.
+		static TypedBlockFunction find(Symbol type);
+
+	private:
+		struct Entry {
+			Symbol type;
+			TypedBlockFunction function;
+		};
+
+		// Provided by the generated code.
+		static const Entry m_entries[];
+		static const size_t m_entryCount;
+	};
+}
+
+#endif
@@ -2,8 +2,11 @@
 #define NIFPARSE_TYPES_H
 
 #include <variant>
-#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <iterator>
 #include <nifparse/Symbol.h>
+#include <nifparse/Allocator.h>
 #include <sstream>
 
 namespace nifparse {
@@ -13,6 +16,7 @@ namespace nifparse {
 	struct NIFPointer;
 	struct NIFEnum;
 	struct NIFBitflags;
+	struct NIFStructArray;
 
 	using NIFVariant = std::variant<
 		std::monostate,		// Null
@@ -21,42 +25,197 @@ namespace nifparse {
 		NIFArray,			// Generic array
 		NIFEnum,				// Symbol (enum)
 		NIFBitflags,// Symbol array (bitflags)
-		std::vector<unsigned char>,	// Byte array
-		std::string,				// String
+		NIFVector<unsigned char>,	// Byte array
+		NIFString,					// String
 		NIFReference,				// Reference (strong pointer)
 		NIFPointer,					// (Weak) pointer
-		float						// Floating point number
+		float,						// Floating point number
+		NIFVector<uint16_t>,		// Packed ushort array
+		NIFVector<int16_t>,			// Packed short array
+		NIFVector<uint32_t>,		// Packed uint, int or bool array
+		NIFVector<float>,			// Packed float array
+		NIFStructArray				// Packed array of fixed-layout compounds
 	>;
 
-	using StackValue = std::variant<uint32_t, NIFArray>;
+	/*
+	 * A number, or an array field whose elements give the sizes of the rows
+	 * of a jagged array. Arrays are referred to where they were read into, not
+	 * copied, so they have to stay in place while the value is used.
+	 */
+	using StackValue = std::variant<uint32_t, const NIFArray *, const NIFVector<uint16_t> *, const NIFVector<int16_t> *, const NIFVector<uint32_t> *>;
+
+	/*
+	 * Fields a compound type can have, including inherited ones, in the order
+	 * they are read. Shared by all dictionaries of the type, and maps field
+	 * names to slot indices through a small open-addressed table.
+	 */
+	class NIFFieldLayout {
+	public:
+		static constexpr uint32_t NoSlot = static_cast<uint32_t>(~0);
+
+		explicit NIFFieldLayout(std::vector<Symbol> &&fields);
+		~NIFFieldLayout();
+
+		NIFFieldLayout(const NIFFieldLayout &other) = delete;
+		NIFFieldLayout &operator =(const NIFFieldLayout &other) = delete;
+
+		inline const std::vector<Symbol> &fields() const { return m_fields; }
+		inline size_t size() const { return m_fields.size(); }
+
+		inline uint32_t slot(Symbol name) const {
+			if (m_index.empty())
+				return NoSlot;
+
+			auto mask = m_index.size() - 1;
+			for (size_t position = hash(name); ; position = (position + 1) & mask) {
+				auto entry = m_index[position];
+				if (entry == 0)
+					return NoSlot;
+
+				if (m_fields[entry - 1] == name)
+					return entry - 1;
+			}
+		}
+
+	private:
+		inline size_t hash(Symbol name) const {
+			return (static_cast<uint32_t>(name) * 2654435761U) >> m_hashShift;
+		}
+
+		std::vector<Symbol> m_fields;
+		std::vector<uint32_t> m_index;
+		unsigned int m_hashShift;
+	};
+
+	/*
+	 * Field storage of a NIFDictionary. Fields named by the layout live in
+	 * fixed slots, allocated together on the first insertion; any other fields
+	 * are appended after them and found by a linear search. Offers the subset
+	 * of the std::unordered_map interface that dictionaries were used with.
+	 * Iteration visits fields in slot order.
+	 */
+	class NIFFieldMap {
+		template<typename Slot>
+		class Iterator {
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = std::remove_const_t<Slot>;
+			using difference_type = std::ptrdiff_t;
+			using pointer = Slot *;
+			using reference = Slot &;
+
+			inline Iterator() : m_position(nullptr), m_end(nullptr) { }
+
+			inline Iterator(Slot *position, Slot *end) : m_position(position), m_end(end) {
+				skipEmpty();
+			}
+
+			template<typename Other, typename = std::enable_if_t<std::is_convertible_v<Other *, Slot *>>>
+			inline Iterator(const Iterator<Other> &other) : m_position(other.m_position), m_end(other.m_end) { }
+
+			inline reference operator *() const { return *m_position; }
+			inline pointer operator ->() const { return m_position; }
+
+			inline Iterator &operator ++() {
+				++m_position;
+				skipEmpty();
+				return *this;
+			}
+
+			inline Iterator operator ++(int) {
+				auto result = *this;
+				++*this;
+				return result;
+			}
+
+			inline bool operator ==(const Iterator &other) const { return m_position == other.m_position; }
+			inline bool operator !=(const Iterator &other) const { return m_position != other.m_position; }
+
+		private:
+			template<typename Other>
+			friend class Iterator;
+
+			inline void skipEmpty() {
+				while (m_position != m_end && m_position->first.isNull()) {
+					++m_position;
+				}
+			}
+
+			Slot *m_position;
+			Slot *m_end;
+		};
+
+	public:
+		using value_type = std::pair<Symbol, NIFVariant>;
+		using iterator = Iterator<value_type>;
+		using const_iterator = Iterator<const value_type>;
+
+		NIFFieldMap() = default;
+
+		inline const std::shared_ptr<const NIFFieldLayout> &layout() const { return m_layout; }
+
+		// Only valid while the map is empty.
+		void setLayout(std::shared_ptr<const NIFFieldLayout> layout);
+
+		inline iterator begin();
+		inline iterator end();
+		inline const_iterator begin() const;
+		inline const_iterator end() const;
+
+		inline bool empty() const { return size() == 0; }
+		size_t size() const;
+
+		inline iterator find(Symbol key);
+		inline const_iterator find(Symbol key) const;
+		inline size_t count(Symbol key) const { return findSlot(key) == NIFFieldLayout::NoSlot ? 0 : 1; }
+
+		// Pointer to the value of a field, or null if it is not present.
+		inline NIFVariant *findValue(Symbol key);
+		inline const NIFVariant *findValue(Symbol key) const;
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(Symbol key, Args &&... args);
+
+		// Leaves the slot of the field empty. Returns the number of fields removed.
+		size_t erase(Symbol key);
+
+		inline NIFVariant &operator [](Symbol key);
+
+	private:
+		inline size_t findSlot(Symbol key) const;
+		void allocateSlots();
+
+		std::shared_ptr<const NIFFieldLayout> m_layout;
+		NIFVector<value_type> m_slots;
+	};
 
 	struct NIFDictionary {
-		std::unordered_map<Symbol, NIFVariant> data;
-		std::vector<Symbol> typeChain;
+		NIFFieldMap data;
+		NIFVector<Symbol> typeChain;
 		bool isNiObject;
 
 		template<typename T>
 		T &getValue(Symbol key) {
-			auto it = data.find(key);
-			if (it == data.end()) {
+			auto value = data.findValue(key);
+			if (!value) {
 				std::stringstream stream;
 				stream << "No key " << key.toString() << " in dictionary";
 				throw std::runtime_error(stream.str());
 			}
 
-			return std::get<T>(it->second);
+			return std::get<T>(*value);
 		}
 
 		template<typename T>
 		const T &getValue(Symbol key) const {
-			auto it = data.find(key);
-			if (it == data.end()) {
+			auto value = data.findValue(key);
+			if (!value) {
 				std::stringstream stream;
 				stream << "No key " << key.toString() << " in dictionary";
 				throw std::runtime_error(stream.str());
 			}
 
-			return std::get<T>(it->second);
+			return std::get<T>(*value);
 		}
 
 		bool isA(const Symbol &type) const;
@@ -64,9 +223,84 @@ namespace nifparse {
 	};
 
 	struct NIFArray {
-		std::vector<NIFVariant> data;
+		NIFVector<NIFVariant> data;
 	};
 
+	/*
+	 * Layout of a compound type that consists only of unconditional scalar
+	 * fields, or fields of other such compounds, for the file version being
+	 * read. Arrays of such compounds are stored as the bytes they occupy in
+	 * the file, and fields are decoded on access.
+	 */
+	struct NIFStructLayout {
+		enum class FieldType : uint8_t {
+			UInt8,
+			UInt16,
+			Int16,
+			UInt32,
+			Float,
+			HalfFloat,
+			Compound
+		};
+
+		struct Field {
+			Symbol name;
+			FieldType type;
+			uint32_t offset;
+			std::shared_ptr<const NIFStructLayout> layout; // Compound only
+		};
+
+		Symbol type;
+		uint32_t stride;
+		std::vector<Field> fields;
+
+		const Field *findField(Symbol name) const;
+	};
+
+	/*
+	 * Element of a NIFStructArray. Fields read the same as from the
+	 * NIFDictionary the compound would otherwise have been stored as.
+	 */
+	class NIFStructView {
+	public:
+		inline NIFStructView(const NIFStructLayout &layout, const unsigned char *data) : m_layout(&layout), m_data(data) { }
+
+		inline Symbol type() const { return m_layout->type; }
+		inline bool hasField(Symbol key) const { return m_layout->findField(key) != nullptr; }
+
+		NIFVariant value(Symbol key) const;
+
+		template<typename T>
+		T getValue(Symbol key) const {
+			return std::get<T>(value(key));
+		}
+
+		NIFDictionary toDictionary() const;
+
+	private:
+		const NIFStructLayout *m_layout;
+		const unsigned char *m_data;
+	};
+
+	struct NIFStructArray {
+		std::shared_ptr<const NIFStructLayout> layout;
+		NIFVector<unsigned char> data;
+
+		inline size_t size() const { return data.size() / layout->stride; }
+		inline NIFStructView operator[](size_t index) const { return NIFStructView(*layout, data.data() + index * layout->stride); }
+	};
+
+	/*
+	 * Arrays of scalar basic types and of fixed-layout compounds are stored
+	 * packed. These give uniform access to any array alternative, with elements
+	 * converted the same way as elements of a NIFArray.
+	 */
+	size_t arraySize(const NIFVariant &array);
+	NIFVariant arrayElement(const NIFVariant &array, size_t index);
+
+	// Per-row size for a two-dimensional array whose second dimension is given by an array.
+	uint32_t dimensionElement(const StackValue &dimension, size_t index);
+
 	enum class Opcode : uint8_t {
 		BOOL = 1,
 		BYTE = 2,
@@ -132,6 +366,14 @@ namespace nifparse {
 		BRANCHIF = 62,
 		BRANCH = 63,
 		FIELD_DEFAULT = 64,
+
+		// Only used in compiled type plans
+		LOAD_TYPE = 128,
+		SPECIALIZE_TEMPLATE_ARGUMENT = 129,
+		NOP = 130,
+		// A FIELD_VALUE that is only used as a number, so the value is checked to be one as it is read.
+		FIELD_NUMBER = 131,
+
 		END = 255
 	};
 
@@ -154,8 +396,101 @@ namespace nifparse {
 
 	struct NIFBitflags {
 		uint32_t rawValue;
-		std::vector<Symbol> symbolicValues;
+		NIFVector<Symbol> symbolicValues;
 	};
+
+	inline NIFFieldMap::iterator NIFFieldMap::begin() {
+		return iterator(m_slots.data(), m_slots.data() + m_slots.size());
+	}
+
+	inline NIFFieldMap::iterator NIFFieldMap::end() {
+		return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size());
+	}
+
+	inline NIFFieldMap::const_iterator NIFFieldMap::begin() const {
+		return const_iterator(m_slots.data(), m_slots.data() + m_slots.size());
+	}
+
+	inline NIFFieldMap::const_iterator NIFFieldMap::end() const {
+		return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size());
+	}
+
+	inline size_t NIFFieldMap::findSlot(Symbol key) const {
+		size_t overflowStart = 0;
+
+		if (m_layout) {
+			auto slot = m_layout->slot(key);
+			if (slot != NIFFieldLayout::NoSlot) {
+				return slot < m_slots.size() && m_slots[slot].first == key ? slot : NIFFieldLayout::NoSlot;
+			}
+
+			overflowStart = m_layout->size();
+		}
+
+		for (size_t slot = overflowStart; slot < m_slots.size(); slot++) {
+			if (m_slots[slot].first == key)
+				return slot;
+		}
+
+		return NIFFieldLayout::NoSlot;
+	}
+
+	inline NIFFieldMap::iterator NIFFieldMap::find(Symbol key) {
+		auto slot = findSlot(key);
+		if (slot == NIFFieldLayout::NoSlot)
+			return end();
+
+		return iterator(m_slots.data() + slot, m_slots.data() + m_slots.size());
+	}
+
+	inline NIFFieldMap::const_iterator NIFFieldMap::find(Symbol key) const {
+		auto slot = findSlot(key);
+		if (slot == NIFFieldLayout::NoSlot)
+			return end();
+
+		return const_iterator(m_slots.data() + slot, m_slots.data() + m_slots.size());
+	}
+
+	inline NIFVariant *NIFFieldMap::findValue(Symbol key) {
+		auto slot = findSlot(key);
+		return slot == NIFFieldLayout::NoSlot ? nullptr : &m_slots[slot].second;
+	}
+
+	inline const NIFVariant *NIFFieldMap::findValue(Symbol key) const {
+		auto slot = findSlot(key);
+		return slot == NIFFieldLayout::NoSlot ? nullptr : &m_slots[slot].second;
+	}
+
+	template<typename... Args>
+	std::pair<NIFFieldMap::iterator, bool> NIFFieldMap::try_emplace(Symbol key, Args &&... args) {
+		auto slot = m_layout ? m_layout->slot(key) : NIFFieldLayout::NoSlot;
+
+		if (slot == NIFFieldLayout::NoSlot) {
+			slot = findSlot(key);
+			if (slot == NIFFieldLayout::NoSlot) {
+				allocateSlots();
+				slot = m_slots.size();
+				m_slots.emplace_back(key, NIFVariant(std::forward<Args>(args)...));
+				return std::make_pair(iterator(m_slots.data() + slot, m_slots.data() + m_slots.size()), true);
+			}
+		}
+		else {
+			allocateSlots();
+
+			auto &entry = m_slots[slot];
+			if (entry.first.isNull()) {
+				entry.first = key;
+				entry.second = NIFVariant(std::forward<Args>(args)...);
+				return std::make_pair(iterator(m_slots.data() + slot, m_slots.data() + m_slots.size()), true);
+			}
+		}
+
+		return std::make_pair(iterator(m_slots.data() + slot, m_slots.data() + m_slots.size()), false);
+	}
+
+	inline NIFVariant &NIFFieldMap::operator [](Symbol key) {
+		return try_emplace(key).first->second;
+	}
 }
 
 #endif
@@ -2,9 +2,21 @@
 #define NIFPARSE_BYTECODE_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 namespace nifparse {
 	extern const unsigned char nifBytecode[];
+	extern const size_t nifBytecodeSize;
+
+	// Generated along with the bytecode, and indexed by symbol.
+	extern const uint32_t nifSymbolCount;
+	extern const char *const nifSymbolStrings[];
+	// Offset of the type in nifBytecode, or 0xFFFFFFFF if the symbol does not name a type.
+	extern const uint32_t nifSymbolTypeOffsets[];
+
+	// Minimal perfect hash of the symbol strings, see SymbolTable::lookupSymbol.
+	extern const int32_t nifSymbolHashDisplacements[];
+	extern const uint32_t nifSymbolHashSlots[];
 }
 
 #endif
@@ -0,0 +1,20 @@
+#include <nifparse/Allocator.h>
+
+namespace nifparse {
+	static thread_local std::pmr::memory_resource *currentResource = nullptr;
+
+	std::pmr::memory_resource *currentMemoryResource() {
+		if (currentResource)
+			return currentResource;
+
+		return std::pmr::get_default_resource();
+	}
+
+	MemoryResourceScope::MemoryResourceScope(std::pmr::memory_resource *resource) : m_previous(currentResource) {
+		currentResource = resource;
+	}
+
+	MemoryResourceScope::~MemoryResourceScope() {
+		currentResource = m_previous;
+	}
+}
@@ -1,14 +1,24 @@
 #include <nifparse/BytecodeReader.h>
 #include <nifparse/bytecode.h>
 
+#include <stdexcept>
+
 namespace nifparse {
 	BytecodeReader::BytecodeReader(size_t offset) : m_ptr(nifBytecode + offset) {
-
+		if (offset > nifBytecodeSize)
+			throw std::runtime_error("Bytecode offset is out of bounds");
 	}
 
 	BytecodeReader::~BytecodeReader() = default;
 
+	void BytecodeReader::require(size_t length) const {
+		if (length > static_cast<size_t>(nifBytecode + nifBytecodeSize - m_ptr))
+			throw std::runtime_error("Bytecode read is out of bounds");
+	}
+
 	uint8_t BytecodeReader::readByte() {
+		require(1);
+
 		return *m_ptr++;
 	}
 
@@ -17,7 +27,7 @@ namespace nifparse {
 		uint8_t byte;
 
 		do {
-			byte = *m_ptr++;
+			byte = readByte();
 
 			val = (val << 7) | (byte & 0x7F);
 		} while (byte & 0x80);
@@ -27,8 +37,11 @@ namespace nifparse {
 
 	const char *BytecodeReader::readAsciiz() {
 		auto stringPtr = reinterpret_cast<const char *>(m_ptr);
+		auto end = memchr(m_ptr, 0, nifBytecode + nifBytecodeSize - m_ptr);
+		if (!end)
+			throw std::runtime_error("Bytecode string is not terminated");
 		
-		m_ptr += strlen(stringPtr) + 1;
+		m_ptr = static_cast<const uint8_t *>(end) + 1;
 
 		return stringPtr;
 	}
@@ -39,6 +52,8 @@ namespace nifparse {
 			uint16_t value;
 		} u;
 
+		require(2);
+
 		u.bytes[0] = *m_ptr++;
 		u.bytes[1] = *m_ptr++;
 
@@ -46,6 +61,10 @@ namespace nifparse {
 	}
 
 	void BytecodeReader::branch(int displacement) {
+		auto target = static_cast<ptrdiff_t>(position()) + displacement;
+		if (target < 0 || static_cast<size_t>(target) > nifBytecodeSize)
+			throw std::runtime_error("Bytecode branch is out of bounds");
+
 		m_ptr += displacement;
 	}
 
@@ -54,6 +73,8 @@ namespace nifparse {
 	}
 	
 	const unsigned char *BytecodeReader::readBytes(size_t length) {
+		require(length);
+
 		auto result = m_ptr;
 
 		m_ptr += length;
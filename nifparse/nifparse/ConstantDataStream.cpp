@@ -3,7 +3,7 @@
 #include <stdexcept>
 
 namespace nifparse {
-	ConstantDataStream::ConstantDataStream(const unsigned char *data, size_t dataSize) : m_ptr(data), m_end(data + dataSize) {
+	ConstantDataStream::ConstantDataStream(const unsigned char *data, size_t dataSize) : m_begin(data), m_ptr(data), m_end(data + dataSize) {
 
 	}
 
@@ -24,4 +24,20 @@ namespace nifparse {
 		
 		throw std::logic_error("ConstantDataStream is not writable");
 	}
+
+	size_t ConstantDataStream::position() const {
+		return m_ptr - m_begin;
+	}
+
+	void ConstantDataStream::seek(size_t position) {
+		if (position > static_cast<size_t>(m_end - m_begin))
+			throw std::logic_error("ConstantDataStream seek is out of bounds");
+
+		m_ptr = m_begin + position;
+	}
+
+	const unsigned char *ConstantDataStream::window(size_t &size) {
+		size = m_end - m_ptr;
+		return m_ptr;
+	}
 }
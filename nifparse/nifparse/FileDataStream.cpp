@@ -15,4 +15,12 @@ namespace nifparse {
 	void FileDataStream::writeBytes(const unsigned char *bytes, size_t size) {
 		m_stream.write(reinterpret_cast<const char *>(bytes), size);
 	}
+
+	size_t FileDataStream::position() const {
+		return static_cast<size_t>(m_stream.tellg());
+	}
+
+	void FileDataStream::seek(size_t position) {
+		m_stream.seekg(position);
+	}
 }
@@ -0,0 +1,226 @@
+#include <nifparse/MappedFileDataStream.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace nifparse {
+#ifdef _WIN32
+	MappedFileDataStream::MappedFileDataStream(const char *filename) : m_begin(nullptr), m_ptr(nullptr), m_end(nullptr), m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr) {
+		m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			std::stringstream error;
+			error << "Unable to open " << filename << ": error " << GetLastError();
+			throw std::runtime_error(error.str());
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize)) {
+			auto errorCode = GetLastError();
+			unmap();
+
+			std::stringstream error;
+			error << "Unable to query the size of " << filename << ": error " << errorCode;
+			throw std::runtime_error(error.str());
+		}
+
+		if (fileSize.QuadPart == 0)
+			return;
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_mapping) {
+			auto errorCode = GetLastError();
+			unmap();
+
+			std::stringstream error;
+			error << "Unable to map " << filename << ": error " << errorCode;
+			throw std::runtime_error(error.str());
+		}
+
+		auto view = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			auto errorCode = GetLastError();
+			unmap();
+
+			std::stringstream error;
+			error << "Unable to map " << filename << ": error " << errorCode;
+			throw std::runtime_error(error.str());
+		}
+
+		m_begin = static_cast<const unsigned char *>(view);
+		m_ptr = m_begin;
+		m_end = m_begin + static_cast<size_t>(fileSize.QuadPart);
+	}
+
+	void MappedFileDataStream::unmap() {
+		if (m_begin) {
+			UnmapViewOfFile(m_begin);
+		}
+
+		if (m_mapping) {
+			CloseHandle(m_mapping);
+		}
+
+		if (m_file != INVALID_HANDLE_VALUE) {
+			CloseHandle(m_file);
+		}
+	}
+
+	void MappedFileDataStream::advise(AccessHint hint, size_t offset, size_t length) {
+		if (offset >= size())
+			return;
+
+		length = std::min(length, size() - offset);
+
+#if _WIN32_WINNT >= 0x0602
+		if (hint == AccessHint::WillNeed) {
+			WIN32_MEMORY_RANGE_ENTRY range;
+			range.VirtualAddress = const_cast<unsigned char *>(m_begin + offset);
+			range.NumberOfBytes = length;
+
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+#else
+		(void)hint;
+		(void)length;
+#endif
+	}
+#else
+	MappedFileDataStream::MappedFileDataStream(const char *filename) : m_begin(nullptr), m_ptr(nullptr), m_end(nullptr), m_fd(-1) {
+		m_fd = open(filename, O_RDONLY | O_CLOEXEC);
+		if (m_fd < 0) {
+			std::stringstream error;
+			error << "Unable to open " << filename << ": " << strerror(errno);
+			throw std::runtime_error(error.str());
+		}
+
+		struct stat st;
+		if (fstat(m_fd, &st) < 0) {
+			auto errorCode = errno;
+			unmap();
+
+			std::stringstream error;
+			error << "Unable to query the size of " << filename << ": " << strerror(errorCode);
+			throw std::runtime_error(error.str());
+		}
+
+		if (st.st_size == 0)
+			return;
+
+		auto view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (view == MAP_FAILED) {
+			auto errorCode = errno;
+			unmap();
+
+			std::stringstream error;
+			error << "Unable to map " << filename << ": " << strerror(errorCode);
+			throw std::runtime_error(error.str());
+		}
+
+		m_begin = static_cast<const unsigned char *>(view);
+		m_ptr = m_begin;
+		m_end = m_begin + static_cast<size_t>(st.st_size);
+	}
+
+	void MappedFileDataStream::unmap() {
+		if (m_begin) {
+			munmap(const_cast<unsigned char *>(m_begin), size());
+		}
+
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+	}
+
+	void MappedFileDataStream::advise(AccessHint hint, size_t offset, size_t length) {
+		if (offset >= size())
+			return;
+
+		// madvise requires a page-aligned start address.
+
+		auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		auto alignedOffset = offset & ~(pageSize - 1);
+
+		length = std::min(length, size() - offset) + (offset - alignedOffset);
+
+		int advice;
+
+		switch (hint) {
+		case AccessHint::Sequential:
+			advice = MADV_SEQUENTIAL;
+			break;
+
+		case AccessHint::Random:
+			advice = MADV_RANDOM;
+			break;
+
+		case AccessHint::WillNeed:
+			advice = MADV_WILLNEED;
+			break;
+
+		case AccessHint::DontNeed:
+			advice = MADV_DONTNEED;
+			break;
+
+		default:
+			advice = MADV_NORMAL;
+			break;
+		}
+
+		madvise(const_cast<unsigned char *>(m_begin + alignedOffset), length, advice);
+	}
+#endif
+
+	MappedFileDataStream::~MappedFileDataStream() {
+		unmap();
+	}
+
+	void MappedFileDataStream::advise(AccessHint hint) {
+		advise(hint, 0, size());
+	}
+
+	void MappedFileDataStream::readBytes(unsigned char *bytes, size_t size) {
+		if (size > static_cast<size_t>(m_end - m_ptr))
+			throw std::runtime_error("MappedFileDataStream read is out of bounds");
+
+		memcpy(bytes, m_ptr, size);
+
+		m_ptr += size;
+	}
+
+	void MappedFileDataStream::writeBytes(const unsigned char *bytes, size_t size) {
+		(void)bytes;
+		(void)size;
+
+		throw std::logic_error("MappedFileDataStream is not writable");
+	}
+
+	size_t MappedFileDataStream::position() const {
+		return m_ptr - m_begin;
+	}
+
+	void MappedFileDataStream::seek(size_t position) {
+		if (position > static_cast<size_t>(m_end - m_begin))
+			throw std::runtime_error("MappedFileDataStream seek is out of bounds");
+
+		m_ptr = m_begin + position;
+	}
+
+	const unsigned char *MappedFileDataStream::window(size_t &size) {
+		size = m_end - m_ptr;
+		return m_ptr;
+	}
+}
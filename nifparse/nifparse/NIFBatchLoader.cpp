@@ -0,0 +1,201 @@
+#include <nifparse/NIFBatchLoader.h>
+#include <nifparse/NIFFile.h>
+
+#include <algorithm>
+#include <deque>
+#include <system_error>
+#include <thread>
+
+namespace nifparse {
+	struct NIFBatchLoader::Worker {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+		std::thread thread;
+	};
+
+	NIFBatchLoader::Result::Result() : cancelled(false) {
+
+	}
+
+	NIFBatchLoader::Result::~Result() = default;
+
+	NIFBatchLoader::Result::Result(Result &&other) = default;
+
+	NIFBatchLoader::Result &NIFBatchLoader::Result::operator =(Result &&other) = default;
+
+	// The loader and worker the current thread belongs to, so that loads submitted from a completion stay on that worker.
+	static thread_local const NIFBatchLoader *currentLoader = nullptr;
+	static thread_local size_t currentWorker = 0;
+
+	NIFBatchLoader::NIFBatchLoader(unsigned int threads) :
+		m_threadCount(0),
+		m_queued(0),
+		m_outstanding(0),
+		m_stopping(false),
+		m_nextWorker(0),
+		m_generation(0),
+		m_cancelledGeneration(0) {
+
+		if (threads == 0)
+			threads = std::max(1U, std::thread::hardware_concurrency());
+
+		for (unsigned int index = 0; index < threads; index++) {
+			m_workers.emplace_back(std::make_unique<Worker>());
+		}
+
+		try {
+			for (size_t index = 0; index < m_workers.size(); index++) {
+				m_workers[index]->thread = std::thread(&NIFBatchLoader::runWorker, this, index);
+				m_threadCount++;
+			}
+		}
+		catch (const std::system_error &) {
+			// Out of threads: the queues of the workers that did not start are stolen from by the others.
+			if (!m_workers.front()->thread.joinable())
+				throw;
+		}
+	}
+
+	NIFBatchLoader::~NIFBatchLoader() {
+		cancel();
+
+		{
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_stopping = true;
+		}
+
+		m_wakeup.notify_all();
+
+		for (auto &worker : m_workers) {
+			if (worker->thread.joinable())
+				worker->thread.join();
+		}
+	}
+
+	std::future<NIFBatchLoader::Result> NIFBatchLoader::loadAsync(std::string path) {
+		auto promise = std::make_shared<std::promise<Result>>();
+		auto future = promise->get_future();
+
+		loadAsync(std::move(path), [promise](Result &&result) {
+			promise->set_value(std::move(result));
+		});
+
+		return future;
+	}
+
+	void NIFBatchLoader::loadAsync(std::string path, Completion completion) {
+		auto generation = m_generation.load();
+
+		submit([this, path = std::move(path), generation, completion = std::move(completion)]() {
+			runLoad(path, generation, completion);
+		});
+	}
+
+	void NIFBatchLoader::cancel() {
+		m_cancelledGeneration.store(++m_generation);
+	}
+
+	void NIFBatchLoader::wait() {
+		std::unique_lock<std::mutex> locker(m_mutex);
+		m_idle.wait(locker, [this]() { return m_outstanding == 0; });
+	}
+
+	void NIFBatchLoader::submit(std::function<void()> task) {
+		size_t workerIndex;
+		if (currentLoader == this)
+			workerIndex = currentWorker;
+		else
+			workerIndex = m_nextWorker++ % m_workers.size();
+
+		// Counted before it is queued, so that a worker that is woken up may briefly find nothing, but never misses a task.
+		{
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_queued++;
+			m_outstanding++;
+		}
+
+		{
+			auto &worker = *m_workers[workerIndex];
+			std::unique_lock<std::mutex> locker(worker.mutex);
+			worker.tasks.emplace_back(std::move(task));
+		}
+
+		m_wakeup.notify_one();
+	}
+
+	bool NIFBatchLoader::takeTask(size_t workerIndex, std::function<void()> &task) {
+		// The newest task of the worker's own queue, or else the oldest one of another queue.
+		for (size_t offset = 0; offset < m_workers.size(); offset++) {
+			auto &worker = *m_workers[(workerIndex + offset) % m_workers.size()];
+
+			std::unique_lock<std::mutex> locker(worker.mutex);
+			if (worker.tasks.empty())
+				continue;
+
+			if (offset == 0) {
+				task = std::move(worker.tasks.back());
+				worker.tasks.pop_back();
+			}
+			else {
+				task = std::move(worker.tasks.front());
+				worker.tasks.pop_front();
+			}
+
+			locker.unlock();
+
+			std::unique_lock<std::mutex> countLocker(m_mutex);
+			m_queued--;
+			return true;
+		}
+
+		return false;
+	}
+
+	void NIFBatchLoader::runWorker(size_t workerIndex) {
+		currentLoader = this;
+		currentWorker = workerIndex;
+
+		for (;;) {
+			std::function<void()> task;
+
+			if (takeTask(workerIndex, task)) {
+				task();
+				task = nullptr;
+
+				std::unique_lock<std::mutex> locker(m_mutex);
+				if (--m_outstanding == 0)
+					m_idle.notify_all();
+
+				continue;
+			}
+
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_wakeup.wait(locker, [this]() { return m_queued != 0 || m_stopping; });
+
+			if (m_stopping && m_queued == 0)
+				return;
+		}
+	}
+
+	void NIFBatchLoader::runLoad(const std::string &path, uint64_t generation, const Completion &completion) {
+		Result result;
+		result.path = path;
+		result.cancelled = generation < m_cancelledGeneration.load();
+
+		if (!result.cancelled) {
+			try {
+				auto file = std::make_unique<NIFFile>();
+				if (m_fileSetup)
+					m_fileSetup(*file);
+
+				file->parse(path.c_str());
+				result.file = std::move(file);
+			}
+			catch (...) {
+				result.error = std::current_exception();
+			}
+		}
+
+		completion(std::move(result));
+	}
+}
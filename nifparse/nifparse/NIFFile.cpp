@@ -1,94 +1,591 @@
 #include <nifparse/NIFFile.h>
 #include <nifparse/Serializer.h>
+#include <nifparse/NIFVisitor.h>
 #include <nifparse/SerializerContext.h>
+#include <nifparse/Symbols.h>
 #include <nifparse/PrettyPrinter.h>
 #include <nifparse/FileDataStream.h>
-
+#include <nifparse/ConstantDataStream.h>
+#include <nifparse/MappedFileDataStream.h>
+#include <nifparse/PrefetchingFileDataStream.h>
+#include <nifparse/TypePlanCache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 namespace nifparse {
-	NIFFile::NIFFile() = default;
+	NIFFile::NIFFile() : m_memoryResource(&m_arena), m_useNativeCode(true), m_useTypedBlocks(false), m_useLazyDecoding(false), m_usePipelinedInput(false), m_decodeThreads(1), m_visitor(nullptr) {
+
+	}
+
+	struct NIFFile::BlockIndex {
+		const unsigned char *data;
+		size_t dataSize;
+		std::vector<BlockSpan> spans;
+		TypePlanCache *plans;
+		std::unique_ptr<std::once_flag[]> decoded;
+
+		// Blocks may be decoded on several threads at once, which the monotonic arena does not support.
+		std::pmr::synchronized_pool_resource arena;
+
+		// Keeps the data mapped when the file was opened by name.
+		std::unique_ptr<MappedFileDataStream> file;
+	};
+
+	struct NIFFile::IncrementalParse {
+		// Streams opened by beginParse() itself.
+		std::unique_ptr<MappedFileDataStream> file;
+		std::unique_ptr<PrefetchingFileDataStream> prefetchedFile;
+		std::unique_ptr<ConstantDataStream> memory;
+
+		std::unique_ptr<SerializerContext> ctx;
+		const NIFVector<uint32_t> *blockSizes;
+		size_t blockCount;
+		size_t blocksLinked;
+	};
 
 	NIFFile::~NIFFile() = default;
 
+	void NIFFile::setMemoryResource(std::pmr::memory_resource *resource) {
+		m_memoryResource = resource ? resource : &m_arena;
+	}
+
+	void NIFFile::setSkipTypes(const std::unordered_set<Symbol> &types) {
+		if (types.empty()) {
+			m_skipFilter = nullptr;
+			return;
+		}
+
+		m_skipFilter = [types](Symbol type, size_t) {
+			for (; !type.isNull(); type = type.parentType()) {
+				if (types.count(type) != 0)
+					return true;
+			}
+
+			return false;
+		};
+	}
+
 	void NIFFile::parse(std::iostream &ins) {
 		FileDataStream stream(ins);
+		parse(stream);
+	}
+
+	void NIFFile::parse(const char *filename) {
+		if (m_usePipelinedInput && !m_useLazyDecoding) {
+			PrefetchingFileDataStream stream(filename);
+			parse(stream);
+			return;
+		}
+
+		auto stream = std::make_unique<MappedFileDataStream>(filename);
+
+		if (m_useLazyDecoding) {
+			stream->advise(MappedFileDataStream::AccessHint::Random);
+		}
+		else {
+			stream->advise(MappedFileDataStream::AccessHint::Sequential);
+			stream->advise(MappedFileDataStream::AccessHint::WillNeed);
+		}
+
+		parse(*stream);
+
+		// Blocks that are not decoded yet are read from the mapping later on.
+		if (m_blockIndex) {
+			m_blockIndex->file = std::move(stream);
+		}
+	}
+
+	void NIFFile::parse(const unsigned char *data, size_t dataSize) {
+		ConstantDataStream stream(data, dataSize);
+		parse(stream);
+	}
+
+	void NIFFile::parse(INIFDataStream &stream) {
+		MemoryResourceScope memoryScope(m_memoryResource);
+
 		SerializerContext ctx(m_header, stream, false);
+		ctx.setUseNativeCode(m_useNativeCode);
 
-		Serializer::deserialize(ctx, Symbol("Header"), ctx.header);
-		
+		auto blockCount = readHeader(ctx);
 		auto &header = std::get<NIFDictionary>(ctx.header);
-		auto blockCount = header.getValue<uint32_t>(Symbol("Num Blocks"));
+		auto blockSizes = headerBlockSizes();
 
-		m_blocks.reserve(blockCount);
-
-		Symbol symBlockTypeIndex("Block Type Index");
-		Symbol symSizedString("SizedString");
-		Symbol symValue("Value");
+		// Memory-backed data can be read out of order once the extent of every block is known.
+		size_t available;
+		const unsigned char *data = ctx.remainingData(available);
+		bool outOfOrder = data && !m_visitor && (m_useLazyDecoding || m_decodeThreads != 1);
 
-		if (header.data.count(symBlockTypeIndex) == 0) {
+		if (header.data.count(symbols::Block_Type_Index) == 0) {
 			// Morrowind-era format
 
+			if (data && (outOfOrder || (m_skipFilter && !m_visitor))) {
+				// There are no block sizes, so the blocks are measured to find where each one ends.
+				size_t base = ctx.position();
+				std::vector<BlockSpan> spans;
+				spans.reserve(blockCount);
+
+				for (size_t index = 0; index < blockCount; index++) {
+					NIFVariant string;
+					Serializer::deserialize(ctx, symbols::SizedString, string);
+
+					Symbol blockType(std::get<NIFDictionary>(string).getValue<NIFString>(symbols::Value).c_str());
+					m_blockTypes.emplace_back(blockType);
+
+					BlockSpan span;
+					span.offset = ctx.position() - base;
+					Serializer::measure(ctx, blockType);
+					span.size = ctx.position() - base - span.offset;
+					spans.emplace_back(span);
+				}
+
+				readBlocksOutOfOrder(data, available, std::move(spans), ctx.plans());
+			}
+		}
+		else if (blockSizes && blockSizes->size() >= blockCount && outOfOrder) {
+			std::vector<BlockSpan> spans(blockCount);
+			size_t blocksEnd = 0;
+
 			for (size_t index = 0; index < blockCount; index++) {
-				NIFVariant string;
-				Serializer::deserialize(ctx, symSizedString, string);
+				spans[index].offset = blocksEnd;
+				spans[index].size = (*blockSizes)[index];
+				blocksEnd += spans[index].size;
+			}
+
+			if (blocksEnd > available)
+				throw std::logic_error("invalid block length");
 
-				Symbol blockType(std::get<NIFDictionary>(string).getValue<std::string>(symValue).c_str());
+			readBlocksOutOfOrder(data, available, std::move(spans), ctx.plans());
+
+			ctx.seek(ctx.position() + blocksEnd);
+		}
 
-				auto blockValue = std::make_shared<NIFVariant>();
-				Serializer::deserialize(ctx, blockType, *blockValue);
-				
-				m_blocks.emplace_back(std::move(blockValue));
+		while (m_blocks.size() < blockCount) {
+			readNextBlock(ctx, blockSizes);
+		}
+
+		for (const auto &block : m_blocks) {
+			if (block) {
+				linkBlock(*block);
 			}
 		}
-		else {
-			auto &blockTypeArray = header.getValue<NIFArray>(Symbol("Block Type Index"));
-			auto &blockTypes = header.getValue<NIFArray>(Symbol("Block Types"));
 
-			NIFArray *blockSizes = nullptr;
+		readFooter(ctx);
+	}
+
+	void NIFFile::beginParse(const char *filename) {
+		if (m_usePipelinedInput) {
+			auto file = std::make_unique<PrefetchingFileDataStream>(filename);
+
+			beginParse(*file);
+
+			m_incremental->prefetchedFile = std::move(file);
+			return;
+		}
+
+		auto file = std::make_unique<MappedFileDataStream>(filename);
+		file->advise(MappedFileDataStream::AccessHint::Sequential);
+		file->advise(MappedFileDataStream::AccessHint::WillNeed);
 
-			if (header.data.count("Block Size") != 0) {
-				blockSizes = &header.getValue<NIFArray>(Symbol("Block Size"));
+		beginParse(*file);
+
+		m_incremental->file = std::move(file);
+	}
+
+	void NIFFile::beginParse(const unsigned char *data, size_t dataSize) {
+		auto memory = std::make_unique<ConstantDataStream>(data, dataSize);
+
+		beginParse(*memory);
+
+		m_incremental->memory = std::move(memory);
+	}
+
+	void NIFFile::beginParse(INIFDataStream &stream) {
+		MemoryResourceScope memoryScope(m_memoryResource);
+
+		auto state = std::make_unique<IncrementalParse>();
+		state->ctx = std::make_unique<SerializerContext>(m_header, stream, false);
+		state->ctx->setUseNativeCode(m_useNativeCode);
+		state->blockCount = readHeader(*state->ctx);
+		state->blockSizes = headerBlockSizes();
+		state->blocksLinked = 0;
+
+		m_incremental = std::move(state);
+	}
+
+	bool NIFFile::parseNextBlocks(size_t count) {
+		for (size_t step = 0; step < count; step++) {
+			if (parseStep())
+				return true;
+		}
+
+		return false;
+	}
+
+	bool NIFFile::parseFor(std::chrono::steady_clock::duration budget) {
+		auto start = std::chrono::steady_clock::now();
+
+		do {
+			if (parseStep())
+				return true;
+		} while (std::chrono::steady_clock::now() - start < budget);
+
+		return false;
+	}
+
+	NIFFile::ParseProgress NIFFile::parseProgress() const {
+		ParseProgress progress;
+		progress.blocksRead = m_blocks.size();
+		progress.blockCount = m_incremental ? m_incremental->blockCount : m_blocks.size();
+		progress.complete = !m_incremental;
+		return progress;
+	}
+
+	bool NIFFile::parseStep() {
+		if (!m_incremental)
+			throw std::logic_error("no incremental parse is in progress");
+
+		auto &state = *m_incremental;
+
+		try {
+			MemoryResourceScope memoryScope(m_memoryResource);
+
+			if (m_blocks.size() < state.blockCount) {
+				readNextBlock(*state.ctx, state.blockSizes);
+				return false;
+			}
+
+			if (state.blocksLinked < state.blockCount) {
+				auto &block = m_blocks[state.blocksLinked++];
+				if (block) {
+					linkBlock(*block);
+				}
+
+				return false;
 			}
 
-			size_t position = static_cast<size_t>(ins.tellg());
+			readFooter(*state.ctx);
+		}
+		catch (...) {
+			m_incremental.reset();
+			throw;
+		}
+
+		m_incremental.reset();
+		return true;
+	}
+
+	size_t NIFFile::readHeader(SerializerContext &ctx) {
+		Serializer::deserialize(ctx, symbols::Header, ctx.header);
+
+		auto &header = std::get<NIFDictionary>(ctx.header);
+
+		// Everything past the header is read with plans that have this file's version conditions folded in.
+		ctx.setPlans(TypePlanCache::forVersion(PlanVersion::fromHeader(header)));
+
+		auto blockCount = header.getValue<uint32_t>(symbols::Num_Blocks);
+
+		m_blocks.reserve(blockCount);
+		m_typedBlocks.reserve(blockCount);
+		m_skippedBlocks.assign(blockCount, false);
+		m_blockTypes.reserve(blockCount);
+
+		if (header.data.count(symbols::Block_Type_Index) != 0) {
+			auto &blockTypeArray = header.getValue<NIFVector<uint16_t>>(symbols::Block_Type_Index);
+			auto &blockTypes = header.getValue<NIFArray>(symbols::Block_Types);
 
 			for (size_t index = 0; index < blockCount; index++) {
-				auto blockTypeIndex = std::get<uint32_t>(blockTypeArray.data[index]);
+				auto blockTypeIndex = blockTypeArray[index];
 				if (blockTypeIndex >= blockTypes.data.size())
 					throw std::logic_error("block type index is out of range");
 
-				Symbol blockType(std::get<NIFDictionary>(blockTypes.data[blockTypeIndex]).getValue<std::string>(Symbol("Value")).c_str());
+				m_blockTypes.emplace_back(std::get<NIFDictionary>(blockTypes.data[blockTypeIndex]).getValue<NIFString>(symbols::Value).c_str());
+			}
+		}
+
+		return blockCount;
+	}
 
-				auto blockValue = std::make_shared<NIFVariant>();
-				Serializer::deserialize(ctx, blockType, *blockValue);
-				
-				size_t endPosition = static_cast<size_t>(ins.tellg());
+	const NIFVector<uint32_t> *NIFFile::headerBlockSizes() const {
+		auto blockSizes = std::get<NIFDictionary>(m_header).data.findValue(symbols::Block_Size);
+		return blockSizes ? &std::get<NIFVector<uint32_t>>(*blockSizes) : nullptr;
+	}
 
-				if (blockSizes) {
-					size_t blockSize = endPosition - position;
-					size_t expectedBlockSize = std::get<uint32_t>(blockSizes->data[index]);
+	void NIFFile::readNextBlock(SerializerContext &ctx, const NIFVector<uint32_t> *blockSizes) {
+		size_t index = m_blocks.size();
+		size_t position = ctx.position();
 
-					if (blockSize != expectedBlockSize) {
-						throw std::logic_error("invalid block length");
-					}
-				}
+		// Morrowind-era files give the type in front of every block, later ones list all of them in the header.
+		if (index == m_blockTypes.size()) {
+			NIFVariant string;
+			Serializer::deserialize(ctx, symbols::SizedString, string);
 
-				position = endPosition;
+			m_blockTypes.emplace_back(std::get<NIFDictionary>(string).getValue<NIFString>(symbols::Value).c_str());
+			position = ctx.position();
+		}
 
-				m_blocks.emplace_back(std::move(blockValue));
-			}
+		auto blockType = m_blockTypes[index];
+		std::shared_ptr<TypedBlock> typedBlock;
+		std::shared_ptr<NIFVariant> blockValue;
+
+		// Without the size, there is no way to pass over a block without reading it.
+		if (blockSizes && skipBlock(blockType, index)) {
+			blockValue = skippedBlock(blockType);
+			ctx.seek(position + (*blockSizes)[index]);
+		}
+		else {
+			blockValue = readBlock(ctx, blockType, index, typedBlock);
 		}
 
-		for (const auto &block : m_blocks) {
-			linkBlock(*block);
+		if (blockSizes) {
+			size_t blockSize = ctx.position() - position;
+			size_t expectedBlockSize = (*blockSizes)[index];
+
+			if (blockSize != expectedBlockSize) {
+				throw std::logic_error("invalid block length");
+			}
 		}
 
-		Serializer::deserialize(ctx, Symbol("Footer"), m_footer);
-		
+		m_blocks.emplace_back(std::move(blockValue));
+		m_typedBlocks.emplace_back(std::move(typedBlock));
+	}
+
+	void NIFFile::readFooter(SerializerContext &ctx) {
+		Serializer::deserialize(ctx, symbols::Footer, m_footer);
+
 		linkBlock(m_footer);
 	}
 
+	std::shared_ptr<NIFVariant> NIFFile::readBlock(SerializerContext &ctx, Symbol blockType, size_t index, std::shared_ptr<TypedBlock> &typedBlock) const {
+		if (m_visitor) {
+			m_visitor->beginBlock(blockType, index);
+			Serializer::visit(ctx, blockType, *m_visitor, projectedFields(blockType));
+			m_visitor->endBlock();
+			return nullptr;
+		}
+
+		auto blockValue = std::allocate_shared<NIFVariant>(NIFAllocator<NIFVariant>());
+
+		auto reader = m_useTypedBlocks ? TypedBlockReader::find(blockType) : nullptr;
+		if (reader) {
+			*blockValue = NIFDictionary();
+			typedBlock = reader(ctx, std::get<NIFDictionary>(*blockValue));
+		}
+		else if (auto fields = projectedFields(blockType)) {
+			Serializer::project(ctx, blockType, *blockValue, *fields);
+		}
+		else {
+			Serializer::deserialize(ctx, blockType, *blockValue);
+		}
+
+		return blockValue;
+	}
+
+	const std::unordered_set<Symbol> *NIFFile::projectedFields(Symbol blockType) const {
+		if (m_projection.empty())
+			return nullptr;
+
+		for (auto type = blockType; !type.isNull(); type = type.parentType()) {
+			auto it = m_projection.find(type);
+			if (it != m_projection.end())
+				return &it->second;
+		}
+
+		return nullptr;
+	}
+
+	bool NIFFile::skipBlock(Symbol blockType, size_t index) const {
+		if (!m_skipFilter || !m_skipFilter(blockType, index))
+			return false;
+
+		m_skippedBlocks[index] = true;
+		return true;
+	}
+
+	std::shared_ptr<NIFVariant> NIFFile::skippedBlock(Symbol blockType) const {
+		auto blockValue = std::allocate_shared<NIFVariant>(NIFAllocator<NIFVariant>());
+		*blockValue = NIFDictionary();
+
+		auto &placeholder = std::get<NIFDictionary>(*blockValue);
+		for (auto type = blockType; !type.isNull(); type = type.parentType()) {
+			placeholder.typeChain.push_back(type);
+		}
+
+		placeholder.isNiObject = true;
+
+		return blockValue;
+	}
+
+	std::shared_ptr<NIFVariant> NIFFile::readBlockAt(const unsigned char *data, size_t dataSize, const BlockSpan &span, size_t index, TypePlanCache &plans,
+		std::shared_ptr<TypedBlock> &typedBlock) const {
+
+		auto blockType = m_blockTypes[index];
+
+		if (skipBlock(blockType, index))
+			return skippedBlock(blockType);
+
+		// The stream extends to the end of the data, so that an overlong block is reported the same way as when reading in order.
+		ConstantDataStream stream(data + span.offset, dataSize - span.offset);
+
+		// Blocks only ever read the header.
+		SerializerContext ctx(const_cast<NIFVariant &>(m_header), stream, false);
+		ctx.setPlans(plans);
+		ctx.setUseNativeCode(m_useNativeCode);
+
+		auto blockValue = readBlock(ctx, blockType, index, typedBlock);
+
+		if (ctx.position() != span.size) {
+			throw std::logic_error("invalid block length");
+		}
+
+		return blockValue;
+	}
+
+	static void runOnThreads(unsigned int threads, size_t taskCount, const std::function<void(size_t index)> &task) {
+		std::atomic<size_t> nextTask(0);
+
+		auto worker = [&]() {
+			size_t index;
+			while ((index = nextTask.fetch_add(1, std::memory_order_relaxed)) < taskCount) {
+				task(index);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(threads - 1);
+
+		try {
+			while (pool.size() + 1 < threads && pool.size() + 1 < taskCount) {
+				pool.emplace_back(worker);
+			}
+		}
+		catch (const std::system_error &) {
+			// Out of threads: the ones already started and this one take all of the tasks.
+		}
+
+		worker();
+
+		for (auto &thread : pool) {
+			thread.join();
+		}
+	}
+
+	void NIFFile::readBlocksOutOfOrder(const unsigned char *data, size_t dataSize, std::vector<BlockSpan> &&spans, TypePlanCache &plans) {
+		if (m_useLazyDecoding) {
+			indexBlocks(data, dataSize, std::move(spans), plans);
+		}
+		else {
+			readBlocksParallel(data, dataSize, spans, plans);
+		}
+	}
+
+	void NIFFile::readBlocksParallel(const unsigned char *data, size_t dataSize, const std::vector<BlockSpan> &spans, TypePlanCache &plans) {
+		unsigned int threads = m_decodeThreads;
+		if (threads == 0)
+			threads = std::max(1U, std::thread::hardware_concurrency());
+
+		size_t blockCount = spans.size();
+
+		/*
+		 * Each task reads a contiguous run of blocks, split so that the runs
+		 * have about the same number of bytes. A few runs per thread let the
+		 * threads that finish early pick up the remainder.
+		 */
+		uint64_t taskCount = std::min<uint64_t>(blockCount, threads * 4U);
+		uint64_t totalSize = blockCount == 0 ? 0 : spans.back().offset + spans.back().size - spans.front().offset;
+		std::vector<size_t> taskBlocks{ 0 };
+
+		for (size_t index = 0; index < blockCount; index++) {
+			uint64_t blockEnd = spans[index].offset + spans[index].size - spans.front().offset;
+
+			if (index + 1 == blockCount || blockEnd * taskCount >= totalSize * taskBlocks.size()) {
+				taskBlocks.emplace_back(index + 1);
+			}
+		}
+
+		std::vector<std::pmr::memory_resource *> resources(taskBlocks.size() - 1, m_memoryResource);
+		if (m_memoryResource == &m_arena) {
+			for (auto &resource : resources) {
+				m_taskArenas.emplace_back(std::make_unique<std::pmr::monotonic_buffer_resource>());
+				resource = m_taskArenas.back().get();
+			}
+		}
+
+		m_blocks.resize(blockCount);
+		m_typedBlocks.resize(blockCount);
+
+		std::mutex errorMutex;
+		std::exception_ptr error;
+		size_t errorBlock = blockCount;
+		std::atomic<bool> failed(false);
+
+		auto task = [&](size_t taskIndex) {
+			size_t index = taskBlocks[taskIndex];
+
+			try {
+				MemoryResourceScope memoryScope(resources[taskIndex]);
+
+				for (; index < taskBlocks[taskIndex + 1] && !failed.load(std::memory_order_relaxed); index++) {
+					m_blocks[index] = readBlockAt(data, dataSize, spans[index], index, plans, m_typedBlocks[index]);
+				}
+			}
+			catch (...) {
+				// Of several failures, report the one in the first block, which is what reading in order would have hit.
+				std::unique_lock<std::mutex> locker(errorMutex);
+				if (index < errorBlock) {
+					error = std::current_exception();
+					errorBlock = index;
+				}
+
+				failed.store(true, std::memory_order_relaxed);
+			}
+		};
+
+		if (m_blockExecutor) {
+			m_blockExecutor(taskBlocks.size() - 1, task);
+		}
+		else {
+			runOnThreads(threads, taskBlocks.size() - 1, task);
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	void NIFFile::indexBlocks(const unsigned char *data, size_t dataSize, std::vector<BlockSpan> &&spans, TypePlanCache &plans) {
+		auto blockIndex = std::make_unique<BlockIndex>();
+		blockIndex->data = data;
+		blockIndex->dataSize = dataSize;
+		blockIndex->spans = std::move(spans);
+		blockIndex->plans = &plans;
+		blockIndex->decoded.reset(new std::once_flag[blockIndex->spans.size()]);
+
+		m_blocks.resize(blockIndex->spans.size());
+		m_typedBlocks.resize(blockIndex->spans.size());
+
+		m_blockIndex = std::move(blockIndex);
+	}
+
+	void NIFFile::decodeBlock(size_t index) const {
+		auto &blockIndex = *m_blockIndex;
+
+		// A block that fails to decode stays undecoded, and the next access tries again.
+		std::call_once(blockIndex.decoded[index], [&]() {
+			MemoryResourceScope memoryScope(m_memoryResource == &m_arena ? &blockIndex.arena : m_memoryResource);
+
+			std::shared_ptr<TypedBlock> typedBlock;
+			auto blockValue = readBlockAt(blockIndex.data, blockIndex.dataSize, blockIndex.spans[index], index, *blockIndex.plans, typedBlock);
+
+			m_blocks[index] = std::move(blockValue);
+			m_typedBlocks[index] = std::move(typedBlock);
+		});
+	}
+
 	void NIFFile::linkBlock(NIFVariant &value) {
 		std::visit([=](auto &&val) {
 			doLinkBlock(val);
@@ -125,6 +622,58 @@ namespace nifparse {
 		}
 	}
 
+	size_t NIFFile::blockCount() const {
+		return m_blocks.size();
+	}
+
+	std::shared_ptr<NIFVariant> NIFFile::block(int32_t target) const {
+		if (target < 0 || static_cast<size_t>(target) >= m_blocks.size())
+			return nullptr;
+
+		if (m_blockIndex) {
+			decodeBlock(target);
+		}
+
+		return m_blocks[target];
+	}
+
+	Symbol NIFFile::blockType(int32_t target) const {
+		if (target < 0 || static_cast<size_t>(target) >= m_blockTypes.size())
+			return Symbol();
+
+		return m_blockTypes[target];
+	}
+
+	std::shared_ptr<NIFVariant> NIFFile::resolve(const NIFReference &ref) const {
+		return block(ref.target);
+	}
+
+	std::shared_ptr<NIFVariant> NIFFile::resolve(const NIFPointer &ptr) const {
+		return block(ptr.target);
+	}
+
+	bool NIFFile::blockSkipped(int32_t target) const {
+		if (target < 0 || static_cast<size_t>(target) >= m_skippedBlocks.size())
+			return false;
+
+		if (m_blockIndex) {
+			decodeBlock(target);
+		}
+
+		return m_skippedBlocks[target];
+	}
+
+	TypedBlock *NIFFile::typedBlock(int32_t target) const {
+		if (target < 0 || static_cast<size_t>(target) >= m_typedBlocks.size())
+			return nullptr;
+
+		if (m_blockIndex) {
+			decodeBlock(target);
+		}
+
+		return m_typedBlocks[target].get();
+	}
+
 	NIFDictionary &NIFFile::header() {
 		return std::get<NIFDictionary>(m_header);
 	}
@@ -134,10 +683,10 @@ namespace nifparse {
 	}
 
 	NIFArray &NIFFile::rootObjects() {
-		return std::get<NIFDictionary>(m_footer).getValue<NIFArray>("Roots");
+		return std::get<NIFDictionary>(m_footer).getValue<NIFArray>(symbols::Roots);
 	}
 
 	const NIFArray &NIFFile::rootObjects() const {
-		return std::get<NIFDictionary>(m_footer).getValue<NIFArray>("Roots");
+		return std::get<NIFDictionary>(m_footer).getValue<NIFArray>(symbols::Roots);
 	}
 }
@@ -0,0 +1,106 @@
+#include <nifparse/NIFVisitor.h>
+
+namespace nifparse {
+	NIFVisitor::NIFVisitor() = default;
+
+	NIFVisitor::~NIFVisitor() = default;
+
+	void NIFVisitor::beginBlock(Symbol type, size_t index) {
+		(void)type;
+		(void)index;
+	}
+
+	void NIFVisitor::endBlock() {
+
+	}
+
+	void NIFVisitor::beginCompound(Symbol name, Symbol type) {
+		(void)name;
+		(void)type;
+	}
+
+	void NIFVisitor::endCompound() {
+
+	}
+
+	void NIFVisitor::beginArray(Symbol name, size_t length) {
+		(void)name;
+		(void)length;
+	}
+
+	void NIFVisitor::endArray() {
+
+	}
+
+	void NIFVisitor::scalar(Symbol name, const NIFVariant &value) {
+		(void)name;
+		(void)value;
+	}
+
+	void NIFVisitor::bytes(Symbol name, const unsigned char *data, size_t size) {
+		(void)name;
+		(void)data;
+		(void)size;
+	}
+
+	void NIFVisitor::packedArray(Symbol name, const NIFVariant &array) {
+		(void)name;
+		(void)array;
+	}
+
+	void NIFVisitor::reference(Symbol name, Symbol type, int32_t target) {
+		(void)name;
+		(void)type;
+		(void)target;
+	}
+
+	void NIFVisitor::pointer(Symbol name, Symbol type, int32_t target) {
+		(void)name;
+		(void)type;
+		(void)target;
+	}
+
+	void NIFVisitor::visitValue(Symbol name, const NIFVariant &value) {
+		std::visit([this, name, &value](auto &&val) {
+			using T = std::decay_t<decltype(val)>;
+
+			if constexpr (std::is_same_v<T, std::monostate>) {
+			}
+			else if constexpr (std::is_same_v<T, NIFDictionary>) {
+				beginCompound(name, val.typeChain.empty() ? Symbol() : val.typeChain.front());
+
+				for (const auto &field : val.data) {
+					visitValue(field.first, field.second);
+				}
+
+				endCompound();
+			}
+			else if constexpr (std::is_same_v<T, NIFArray>) {
+				beginArray(name, val.data.size());
+
+				for (const auto &element : val.data) {
+					visitValue(Symbol(), element);
+				}
+
+				endArray();
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<unsigned char>> || std::is_same_v<T, NIFString>) {
+				bytes(name, reinterpret_cast<const unsigned char *>(val.data()), val.size());
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<uint16_t>> || std::is_same_v<T, NIFVector<int16_t>> ||
+				std::is_same_v<T, NIFVector<uint32_t>> || std::is_same_v<T, NIFVector<float>> ||
+				std::is_same_v<T, NIFStructArray>) {
+				packedArray(name, value);
+			}
+			else if constexpr (std::is_same_v<T, NIFReference>) {
+				reference(name, val.type, val.target);
+			}
+			else if constexpr (std::is_same_v<T, NIFPointer>) {
+				pointer(name, val.type, val.target);
+			}
+			else {
+				scalar(name, value);
+			}
+		}, value);
+	}
+}
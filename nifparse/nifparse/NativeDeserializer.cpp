@@ -0,0 +1,210 @@
+#include <nifparse/NativeDeserializer.h>
+#include <nifparse/Symbols.h>
+#include <nifparse/TypePlanCache.h>
+#include <nifparse/TypePlan.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace nifparse {
+	NativeDeserializerFunction NativeDeserializer::find(Symbol type) {
+#ifdef NIFPARSE_NATIVE_CODE
+		static const std::vector<NativeDeserializerFunction> functions = [] {
+			std::vector<NativeDeserializerFunction> table(Symbol::count(), nullptr);
+
+			for (size_t index = 0; index < m_entryCount; index++) {
+				table[m_entries[index].type] = m_entries[index].function;
+			}
+
+			return table;
+		}();
+
+		if (static_cast<uint32_t>(type) >= functions.size())
+			return nullptr;
+
+		return functions[type];
+#else
+		(void)type;
+		return nullptr;
+#endif
+	}
+
+	NIFDictionary &NativeDeserializer::beginCompound(SerializerContext &ctx, NIFVariant &value, Symbol type) {
+		if (std::holds_alternative<std::monostate>(value)) {
+			value = NIFDictionary();
+			std::get<NIFDictionary>(value).data.setLayout(ctx.plans().plan(type).fieldLayout());
+		}
+
+		auto &dictionary = std::get<NIFDictionary>(value);
+		dictionary.isNiObject = false;
+		dictionary.typeChain.push_back(type);
+		return dictionary;
+	}
+
+	NIFReference NativeDeserializer::readReference(SerializerContext &ctx, Symbol type) {
+		NIFReference ref;
+		ref.target = ctx.read<int32_t>();
+		ref.type = type;
+		return ref;
+	}
+
+	NIFPointer NativeDeserializer::readPointer(SerializerContext &ctx, Symbol type) {
+		NIFPointer ptr;
+		ptr.target = ctx.read<int32_t>();
+		ptr.type = type;
+		return ptr;
+	}
+
+	const TypeDescription &NativeDeserializer::templateArgument(const TypeDescription *specialization) {
+		if (!specialization)
+			throw std::runtime_error("template type is not specialized");
+
+		return *specialization;
+	}
+
+	Symbol NativeDeserializer::templateTypeName(const TypeDescription *specialization) {
+		const auto &argument = templateArgument(specialization);
+
+		if (argument.type() != TypeDescription::Type::NamedType) {
+			throw std::logic_error("Ref specialization has invalid type");
+		}
+
+		return argument.typeName();
+	}
+
+	NIFVariant NativeDeserializer::readTemplate(SerializerContext &ctx, const TypeDescription *specialization, uint32_t arg) {
+		TypeDescription description(templateArgument(specialization));
+		description.setArg(arg);
+		return description.readValue(ctx);
+	}
+
+	NIFVariant NativeDeserializer::readNamedArray(SerializerContext &ctx, NativeDeserializerFunction function, Symbol type, uint32_t size, uint32_t arg, const TypeDescription *specialization) {
+		const auto &layout = ctx.plans().plan(type).structLayout();
+		if (layout) {
+			return TypeDescription::readStructArray(ctx, layout, size);
+		}
+
+		NIFArray array;
+		array.data.reserve(size);
+		for (uint32_t index = 0; index < size; index++) {
+			array.data.emplace_back(readNamed(ctx, function, arg, specialization));
+		}
+
+		return array;
+	}
+
+	uint32_t NativeDeserializer::value(const NIFDictionary &dictionary, Symbol name) {
+		auto it = dictionary.data.find(name);
+		if (it == dictionary.data.end()) {
+			if (name.isTypeName()) {
+				return std::find(dictionary.typeChain.begin(), dictionary.typeChain.end(), name) != dictionary.typeChain.end();
+			}
+			else {
+				return 0;
+			}
+		}
+
+		const auto &value = it->second;
+
+		if (auto enumval = std::get_if<NIFEnum>(&value)) {
+			return enumval->rawValue;
+		}
+		else if (auto bitval = std::get_if<NIFBitflags>(&value)) {
+			return bitval->rawValue;
+		}
+		else {
+			return std::get<uint32_t>(value);
+		}
+	}
+
+	StackValue NativeDeserializer::stackValue(const NIFDictionary &dictionary, Symbol name) {
+		auto it = dictionary.data.find(name);
+		if (it != dictionary.data.end()) {
+			const auto &field = it->second;
+
+			if (auto arrayval = std::get_if<NIFArray>(&field)) {
+				return arrayval;
+			}
+			else if (auto arrayval = std::get_if<NIFVector<uint16_t>>(&field)) {
+				return arrayval;
+			}
+			else if (auto arrayval = std::get_if<NIFVector<int16_t>>(&field)) {
+				return arrayval;
+			}
+			else if (auto arrayval = std::get_if<NIFVector<uint32_t>>(&field)) {
+				return arrayval;
+			}
+		}
+
+		return value(dictionary, name);
+	}
+
+	const NIFDictionary &NativeDeserializer::indirect(const NIFDictionary &dictionary, Symbol name) {
+		auto it = dictionary.data.find(name);
+		if (it == dictionary.data.end()) {
+			std::stringstream error;
+			error << "Required field is not in dictionary: " << name.toString();
+			throw std::runtime_error(error.str());
+		}
+
+		return std::get<NIFDictionary>(it->second);
+	}
+
+	uint32_t NativeDeserializer::dimension(const NIFDictionary &dictionary, Symbol name, uint32_t outerIndex) {
+		auto it = dictionary.data.find(name);
+		if (it != dictionary.data.end()) {
+			const auto &field = it->second;
+
+			if (std::holds_alternative<NIFArray>(field) || std::holds_alternative<NIFVector<uint16_t>>(field) ||
+				std::holds_alternative<NIFVector<int16_t>>(field) || std::holds_alternative<NIFVector<uint32_t>>(field)) {
+				if (outerIndex == static_cast<uint32_t>(~0)) {
+					throw std::runtime_error("dynamic array size at outer level");
+				}
+
+				return std::get<uint32_t>(arrayElement(field, outerIndex));
+			}
+		}
+
+		return value(dictionary, name);
+	}
+
+	uint32_t NativeDeserializer::headerField(SerializerContext &ctx, Symbol name, Symbol fallbackName) {
+		const auto &header = std::get<NIFDictionary>(ctx.header).data;
+		auto it = header.find(name);
+		if (it == header.end() && !fallbackName.isNull()) {
+			it = header.find(fallbackName);
+		}
+
+		if (it == header.end()) {
+			std::stringstream error;
+			error << "Required field is not in dictionary: " << name.toString();
+			throw std::runtime_error(error.str());
+		}
+
+		return std::get<uint32_t>(it->second);
+	}
+
+	uint32_t NativeDeserializer::version(SerializerContext &ctx) {
+		const auto &plans = ctx.plans();
+		if (plans.isSpecialized() && (plans.version().presentFields & PlanVersion::HasVersion))
+			return plans.version().version;
+
+		return headerField(ctx, symbols::Version, symbols::Header_String);
+	}
+
+	uint32_t NativeDeserializer::userVersion(SerializerContext &ctx) {
+		const auto &plans = ctx.plans();
+		if (plans.isSpecialized() && (plans.version().presentFields & PlanVersion::HasUserVersion))
+			return plans.version().userVersion;
+
+		return headerField(ctx, symbols::User_Version);
+	}
+
+	uint32_t NativeDeserializer::userVersion2(SerializerContext &ctx) {
+		const auto &plans = ctx.plans();
+		if (plans.isSpecialized() && (plans.version().presentFields & PlanVersion::HasUserVersion2))
+			return plans.version().userVersion2;
+
+		return headerField(ctx, symbols::User_Version_2);
+	}
+}
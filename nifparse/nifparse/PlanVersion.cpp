@@ -0,0 +1,61 @@
+#include <nifparse/PlanVersion.h>
+#include <nifparse/Symbols.h>
+
+#include <tuple>
+
+namespace nifparse {
+	PlanVersion::PlanVersion() : presentFields(0), version(0), userVersion(0), userVersion2(0) {
+
+	}
+
+	bool PlanVersion::headerField(Symbol field, uint32_t &value) const {
+		if (field == symbols::Version && (presentFields & HasVersion)) {
+			value = version;
+			return true;
+		}
+		else if (field == symbols::User_Version && (presentFields & HasUserVersion)) {
+			value = userVersion;
+			return true;
+		}
+		else if (field == symbols::User_Version_2 && (presentFields & HasUserVersion2)) {
+			value = userVersion2;
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	bool PlanVersion::operator <(const PlanVersion &other) const {
+		return std::tie(presentFields, version, userVersion, userVersion2) <
+			std::tie(other.presentFields, other.version, other.userVersion, other.userVersion2);
+	}
+
+	PlanVersion PlanVersion::fromHeader(const NIFDictionary &header) {
+		PlanVersion result;
+
+		auto lookup = [&](Symbol name, uint32_t flag, uint32_t &value) {
+			auto it = header.data.find(name);
+			if (it == header.data.end())
+				return false;
+
+			auto integer = std::get_if<uint32_t>(&it->second);
+			if (integer) {
+				result.presentFields |= flag;
+				value = *integer;
+			}
+
+			return true;
+		};
+
+		// Mirrors HEADER_FIELD: pre-10.0.1.0 headers only carry the version in the header string.
+		if (!lookup(symbols::Version, HasVersion, result.version)) {
+			lookup(symbols::Header_String, HasVersion, result.version);
+		}
+
+		lookup(symbols::User_Version, HasUserVersion, result.userVersion);
+		lookup(symbols::User_Version_2, HasUserVersion2, result.userVersion2);
+
+		return result;
+	}
+}
@@ -0,0 +1,286 @@
+#include <nifparse/PrefetchingFileDataStream.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace nifparse {
+	PrefetchingFileDataStream::PrefetchingFileDataStream(const char *filename, size_t bufferSize, size_t bufferCount) :
+		m_filename(filename),
+		m_size(0),
+		m_bufferSize(bufferSize),
+		m_bufferCount(bufferCount),
+		m_position(0),
+		m_firstBuffer(0),
+		m_nextBuffer(0),
+		m_generation(0),
+		m_stopping(false) {
+
+		if (bufferSize == 0 || bufferCount == 0)
+			throw std::logic_error("PrefetchingFileDataStream needs at least one buffer of at least one byte");
+
+#ifdef _WIN32
+		m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE) {
+			std::stringstream error;
+			error << "Unable to open " << filename << ": error " << GetLastError();
+			throw std::runtime_error(error.str());
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize)) {
+			auto errorCode = GetLastError();
+			close();
+
+			std::stringstream error;
+			error << "Unable to query the size of " << filename << ": error " << errorCode;
+			throw std::runtime_error(error.str());
+		}
+
+		m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		m_fd = open(filename, O_RDONLY | O_CLOEXEC);
+		if (m_fd < 0) {
+			std::stringstream error;
+			error << "Unable to open " << filename << ": " << strerror(errno);
+			throw std::runtime_error(error.str());
+		}
+
+		struct stat st;
+		if (fstat(m_fd, &st) < 0) {
+			auto errorCode = errno;
+			close();
+
+			std::stringstream error;
+			error << "Unable to query the size of " << filename << ": " << strerror(errorCode);
+			throw std::runtime_error(error.str());
+		}
+
+		m_size = static_cast<size_t>(st.st_size);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+
+		// Small files do not need the whole ring.
+		m_bufferCount = std::max<size_t>(1, std::min(m_bufferCount, (m_size + m_bufferSize - 1) / m_bufferSize));
+
+		try {
+			m_buffers = std::make_unique<unsigned char[]>(m_bufferSize * m_bufferCount);
+			m_reader = std::thread(&PrefetchingFileDataStream::runReader, this);
+		}
+		catch (...) {
+			close();
+			throw;
+		}
+	}
+
+	PrefetchingFileDataStream::~PrefetchingFileDataStream() {
+		{
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_stopping = true;
+		}
+
+		m_readerWakeup.notify_one();
+		m_reader.join();
+
+		close();
+	}
+
+#ifdef _WIN32
+	void PrefetchingFileDataStream::close() {
+		if (m_file != INVALID_HANDLE_VALUE) {
+			CloseHandle(m_file);
+			m_file = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	void PrefetchingFileDataStream::readAt(size_t offset, unsigned char *data, size_t size) {
+		while (size != 0) {
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = static_cast<DWORD>(offset);
+			overlapped.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+
+			DWORD bytesRead;
+			if (!ReadFile(m_file, data, static_cast<DWORD>(std::min<size_t>(size, 1 << 30)), &bytesRead, &overlapped)) {
+				std::stringstream error;
+				error << "Unable to read " << m_filename << ": error " << GetLastError();
+				throw std::runtime_error(error.str());
+			}
+
+			if (bytesRead == 0) {
+				std::stringstream error;
+				error << "Unable to read " << m_filename << ": the file was truncated";
+				throw std::runtime_error(error.str());
+			}
+
+			offset += bytesRead;
+			data += bytesRead;
+			size -= bytesRead;
+		}
+	}
+#else
+	void PrefetchingFileDataStream::close() {
+		if (m_fd >= 0) {
+			::close(m_fd);
+			m_fd = -1;
+		}
+	}
+
+	void PrefetchingFileDataStream::readAt(size_t offset, unsigned char *data, size_t size) {
+		while (size != 0) {
+			auto bytesRead = pread(m_fd, data, size, static_cast<off_t>(offset));
+			if (bytesRead < 0) {
+				if (errno == EINTR)
+					continue;
+
+				std::stringstream error;
+				error << "Unable to read " << m_filename << ": " << strerror(errno);
+				throw std::runtime_error(error.str());
+			}
+
+			if (bytesRead == 0) {
+				std::stringstream error;
+				error << "Unable to read " << m_filename << ": the file was truncated";
+				throw std::runtime_error(error.str());
+			}
+
+			offset += static_cast<size_t>(bytesRead);
+			data += bytesRead;
+			size -= static_cast<size_t>(bytesRead);
+		}
+	}
+#endif
+
+	void PrefetchingFileDataStream::runReader() {
+		std::unique_lock<std::mutex> locker(m_mutex);
+
+		for (;;) {
+			m_readerWakeup.wait(locker, [this]() {
+				return m_stopping ||
+					(!m_error && m_nextBuffer < m_firstBuffer + m_bufferCount && m_nextBuffer * m_bufferSize < m_size);
+			});
+
+			if (m_stopping)
+				return;
+
+			auto buffer = m_nextBuffer;
+			auto generation = m_generation;
+
+			locker.unlock();
+
+			// The buffer is not handed out until it is filled, so it is written without the lock.
+			std::exception_ptr error;
+			try {
+				auto offset = buffer * m_bufferSize;
+				readAt(offset, m_buffers.get() + (buffer % m_bufferCount) * m_bufferSize, std::min(m_bufferSize, m_size - offset));
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+
+			locker.lock();
+
+			// Seeking elsewhere in the meantime makes the buffer useless.
+			if (generation != m_generation)
+				continue;
+
+			if (error)
+				m_error = error;
+			else
+				m_nextBuffer = buffer + 1;
+
+			m_bufferReady.notify_one();
+		}
+	}
+
+	const unsigned char *PrefetchingFileDataStream::acquireBuffer(size_t buffer) {
+		std::unique_lock<std::mutex> locker(m_mutex);
+
+		if (buffer < m_firstBuffer || buffer > m_nextBuffer) {
+			m_firstBuffer = buffer;
+			m_nextBuffer = buffer;
+			m_generation++;
+			m_error = nullptr;
+			m_readerWakeup.notify_one();
+		}
+		else if (buffer != m_firstBuffer) {
+			// The buffers before this one are done with, and can be filled again.
+			m_firstBuffer = buffer;
+			m_readerWakeup.notify_one();
+		}
+
+		m_bufferReady.wait(locker, [this, buffer]() { return m_nextBuffer > buffer || m_error; });
+
+		if (m_nextBuffer <= buffer)
+			std::rethrow_exception(m_error);
+
+		return m_buffers.get() + (buffer % m_bufferCount) * m_bufferSize;
+	}
+
+	void PrefetchingFileDataStream::readBytes(unsigned char *bytes, size_t size) {
+		if (size > m_size - m_position)
+			throw std::runtime_error("PrefetchingFileDataStream read is out of bounds");
+
+		while (size != 0) {
+			size_t available;
+			auto data = window(available);
+
+			auto chunk = std::min(size, available);
+			memcpy(bytes, data, chunk);
+
+			m_position += chunk;
+			bytes += chunk;
+			size -= chunk;
+		}
+	}
+
+	void PrefetchingFileDataStream::writeBytes(const unsigned char *bytes, size_t size) {
+		(void)bytes;
+		(void)size;
+
+		throw std::logic_error("PrefetchingFileDataStream is not writable");
+	}
+
+	size_t PrefetchingFileDataStream::position() const {
+		return m_position;
+	}
+
+	void PrefetchingFileDataStream::seek(size_t position) {
+		if (position > m_size)
+			throw std::runtime_error("PrefetchingFileDataStream seek is out of bounds");
+
+		m_position = position;
+	}
+
+	const unsigned char *PrefetchingFileDataStream::window(size_t &size) {
+		if (m_position == m_size) {
+			size = 0;
+			return nullptr;
+		}
+
+		auto buffer = m_position / m_bufferSize;
+		auto bufferStart = buffer * m_bufferSize;
+		auto data = acquireBuffer(buffer);
+
+		size = std::min(m_bufferSize, m_size - bufferStart) - (m_position - bufferStart);
+		return data + (m_position - bufferStart);
+	}
+
+	bool PrefetchingFileDataStream::windowCoversStream() const {
+		return false;
+	}
+}
@@ -89,7 +89,7 @@ namespace nifparse {
 		printValue("");
 	}
 
-	void PrettyPrinter::doPrint(const std::vector<unsigned char> &byteArray) {
+	void PrettyPrinter::doPrint(const NIFVector<unsigned char> &byteArray) {
 		printValue("BYTEARRAY");
 
 		increaseLevel();
@@ -125,7 +125,7 @@ namespace nifparse {
 		decreaseLevel();
 	}
 
-	void PrettyPrinter::doPrint(const std::string &string) {
+	void PrettyPrinter::doPrint(const NIFString &string) {
 		printValueNoNewLine("\"");
 		printValueNoNewLine(string.c_str());
 		printValue("\"");
@@ -170,6 +170,53 @@ namespace nifparse {
 		printValue(std::to_string(val).c_str());
 	}
 
+	void PrettyPrinter::doPrint(const NIFVector<uint16_t> &ary) {
+		printPackedArray(ary);
+	}
+
+	void PrettyPrinter::doPrint(const NIFVector<int16_t> &ary) {
+		printPackedArray(ary);
+	}
+
+	void PrettyPrinter::doPrint(const NIFVector<uint32_t> &ary) {
+		printPackedArray(ary);
+	}
+
+	void PrettyPrinter::doPrint(const NIFVector<float> &ary) {
+		printPackedArray(ary);
+	}
+
+	void PrettyPrinter::doPrint(const NIFStructArray &ary) {
+		printValue("ARRAY");
+
+		increaseLevel();
+
+		for (size_t index = 0, size = ary.size(); index < size; index++) {
+			doPrint(ary[index].toDictionary());
+		}
+
+		decreaseLevel();
+	}
+
+	template<typename T>
+	void PrettyPrinter::printPackedArray(const NIFVector<T> &ary) {
+		printValue("ARRAY");
+
+		increaseLevel();
+
+		// Printed the same way as the equivalent NIFArray.
+		for (auto item : ary) {
+			if constexpr (std::is_same_v<T, float>) {
+				doPrint(item);
+			}
+			else {
+				doPrint(static_cast<uint32_t>(item));
+			}
+		}
+
+		decreaseLevel();
+	}
+
 	void PrettyPrinter::startLine() {
 		if (m_state == State::StartOfLine) {
 			for (size_t level = 0; level < m_level; level++) {
@@ -2,148 +2,312 @@
 #include <nifparse/TypeDescription.h>
 #include <nifparse/SerializerContext.h>
 #include <nifparse/ConstantDataStream.h>
+#include <nifparse/NIFVisitor.h>
+#include <nifparse/TypePlan.h>
+#include <nifparse/TypePlanCache.h>
 
+#include <algorithm>
 #include <sstream>
 
 namespace nifparse {
+#ifdef NIFPARSE_INTERPRETER_STATS
+	static thread_local uint64_t instructionsExecuted = 0;
+#endif
+
+	namespace {
+		/*
+		 * TypePlan verifies plans as they are compiled, so the interpreter
+		 * trusts them to stay within MaxStackDepth and to leave numbers where
+		 * it takes numbers. Building with NIFPARSE_CHECKED_INTERPRETER checks
+		 * every access again, for debugging the verifier.
+		 */
+		class OperandStack {
+		public:
+			OperandStack() : m_depth(0) {}
+
+			OperandStack(const OperandStack &other) = delete;
+			OperandStack &operator =(const OperandStack &other) = delete;
+
+			inline void push(StackValue &&value) {
+				check(m_depth < TypePlan::MaxStackDepth);
+				m_values[m_depth++] = std::move(value);
+			}
+
+			inline void dup() {
+				check(m_depth != 0 && m_depth < TypePlan::MaxStackDepth);
+				m_values[m_depth] = m_values[m_depth - 1];
+				m_depth++;
+			}
+
+			inline StackValue &pop() {
+				check(m_depth != 0);
+				return m_values[--m_depth];
+			}
 
-	Serializer::Serializer(Mode mode, Symbol typeSymbol, NIFVariant &value) :
+			inline uint32_t popNumber() {
+				return number(pop());
+			}
+
+			inline uint32_t &topNumber() {
+				check(m_depth != 0);
+				return number(m_values[m_depth - 1]);
+			}
+
+		private:
+			static inline void check(bool valid) {
+#ifdef NIFPARSE_CHECKED_INTERPRETER
+				if (!valid)
+					throw std::logic_error("operand stack access escaped plan verification");
+#else
+				(void)valid;
+#endif
+			}
+
+			static inline uint32_t &number(StackValue &value) {
+#ifdef NIFPARSE_CHECKED_INTERPRETER
+				return std::get<uint32_t>(value);
+#else
+				return *std::get_if<uint32_t>(&value);
+#endif
+			}
+
+			StackValue m_values[TypePlan::MaxStackDepth];
+			size_t m_depth;
+		};
+	}
+
+	Serializer::Serializer(Mode mode, const TypePlan &plan, NIFVariant &value) :
 		m_mode(mode),
-		m_type(typeSymbol),
-		m_bytecodeReader(typeSymbol.typeBytecodeStartOffset()),
+		m_plan(plan),
 		m_value(value),
 		m_arg(0),
-		m_specialization(nullptr) {
+		m_specialization(nullptr),
+		m_projection(nullptr),
+		m_visitor(nullptr),
+		m_derived(nullptr) {
 
-		auto beginOp = m_bytecodeReader.readByte();
-
-		if (static_cast<Opcode>(beginOp) != Opcode::BEGIN) {
-			throw std::runtime_error("no OP_BEGIN");
-		}
-
-		auto beginTypeId = m_bytecodeReader.readVarInt();
-		if (beginTypeId != typeSymbol) {
-			throw std::runtime_error("mismatched type ID");
-		}
 	}
 
 	Serializer::~Serializer() = default;
 
 	void Serializer::serialize(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value) {
-		Serializer serializer(Mode::Serialize, typeSymbol, value);
+		Serializer serializer(Mode::Serialize, ctx.plans().plan(typeSymbol), value);
 		serializer.execute(ctx);
 	}
 
 	void Serializer::deserialize(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value) {
-		Serializer serializer(Mode::Deserialize, typeSymbol, value);
+		auto native = ctx.nativeDeserializer(typeSymbol);
+		if (native) {
+			native(ctx, value, 0, nullptr);
+			return;
+		}
+
+		Serializer serializer(Mode::Deserialize, ctx.plans().plan(typeSymbol), value);
 		serializer.execute(ctx);
 	}
 
-	void Serializer::execute(SerializerContext &ctx) {
-		auto typeOp = static_cast<Opcode>(m_bytecodeReader.readByte());
+	void Serializer::measure(SerializerContext &ctx, Symbol typeSymbol) {
+		NIFVariant value;
+		Serializer serializer(Mode::Measure, ctx.plans().plan(typeSymbol), value);
+		serializer.execute(ctx);
+	}
 
-		switch (typeOp) {
-		case Opcode::COMPOUND:
+	void Serializer::project(SerializerContext &ctx, Symbol typeSymbol, NIFVariant &value, const std::unordered_set<Symbol> &fields) {
+		Serializer serializer(Mode::Deserialize, ctx.plans().plan(typeSymbol), value);
+		serializer.setProjection(&fields);
+		serializer.execute(ctx);
+	}
+
+	void Serializer::visit(SerializerContext &ctx, Symbol typeSymbol, NIFVisitor &visitor, const std::unordered_set<Symbol> *fields) {
+		NIFVariant value;
+		Serializer serializer(Mode::Visit, ctx.plans().plan(typeSymbol), value);
+		serializer.setProjection(fields);
+		serializer.setVisitor(&visitor);
+		serializer.execute(ctx);
+	}
+
+	void Serializer::execute(SerializerContext &ctx) {
+		switch (m_plan.kind()) {
+		case TypePlan::Kind::Compound:
 			executeCompound(ctx);
 			break;
 
-		case Opcode::BITFLAGS:
-		case Opcode::ENUM:
-			executeEnum(ctx, typeOp);
+		case TypePlan::Kind::Bitflags:
+		case TypePlan::Kind::Enum:
+			executeEnum(ctx);
 			break;
-
-		default:
-		{
-			std::stringstream error;
-			error << "Unsupported type: " << static_cast<unsigned int>(typeOp);
-			throw std::runtime_error(error.str());
-		}
 		}
-
 	}
 
 	void Serializer::executeCompound(SerializerContext &ctx) {
-		if (m_mode == Mode::Deserialize && std::holds_alternative<std::monostate>(m_value)) {
+		if (m_mode != Mode::Serialize && std::holds_alternative<std::monostate>(m_value)) {
 			m_value = NIFDictionary();
+
+			// Measuring and projecting keep only a few fields, which are not worth the slots for all of them.
+			if (m_mode == Mode::Deserialize && !m_projection) {
+				std::get<NIFDictionary>(m_value).data.setLayout(m_plan.fieldLayout());
+			}
 		}
 
-		doExecuteCompound(ctx, std::get<NIFDictionary>(m_value));
+		auto &dictionary = std::get<NIFDictionary>(m_value);
+		doExecuteCompound(ctx, dictionary);
+
+		// Inherited types are read into the same dictionary, which the most derived type cleans up once complete.
+		if (m_mode == Mode::Deserialize && m_projection && !m_derived) {
+			std::vector<Symbol> internalFields;
+			for (const auto &field : dictionary.data) {
+				if (m_projection->count(field.first) == 0)
+					internalFields.emplace_back(field.first);
+			}
+
+			for (auto field : internalFields) {
+				dictionary.data.erase(field);
+			}
+		}
 	}
 
 	void Serializer::doExecuteCompound(SerializerContext &ctx, NIFDictionary &dictionary) {
-		if (m_mode == Mode::Deserialize) {
+		if (m_mode != Mode::Serialize) {
 			dictionary.isNiObject = false;
-			dictionary.typeChain.push_back(m_type);
+			dictionary.typeChain.push_back(m_plan.type());
 		}
 
 		TypeDescription description;
 		bool fieldPresent = true;
 
-		Opcode op;
+		const auto *instructions = m_plan.instructions().data();
+		const TypePlan::Instruction *next = instructions;
+		const TypePlan::Instruction *insn;
 		std::vector<NIFVariant *> indirectionStack;
 
-		do {
-			op = static_cast<Opcode>(m_bytecodeReader.readByte());
+#ifdef NIFPARSE_INTERPRETER_STATS
+		uint64_t executed = 0;
+#define NIFPARSE_COUNT() executed++
+#else
+#define NIFPARSE_COUNT() ((void)0)
+#endif
+
+		OperandStack stack;
+
+		/*
+		 * With GCC and Clang, every handler jumps directly to the handler of
+		 * the next instruction through a table of label addresses, giving each
+		 * its own indirect branch to predict. Elsewhere the handlers are the
+		 * cases of a switch in a loop, as they are everywhere when
+		 * NIFPARSE_SWITCH_DISPATCH is defined to compare the two.
+		 */
+#if defined(__GNUC__) && !defined(NIFPARSE_SWITCH_DISPATCH)
+#define NIFPARSE_THREADED_DISPATCH
+#endif
+
+#ifdef NIFPARSE_THREADED_DISPATCH
+#define NIFPARSE_HANDLER(name) handle_##name:
+#define NIFPARSE_INVALID_HANDLER handle_invalid:
+#define NIFPARSE_DISPATCH() insn = next++; NIFPARSE_COUNT(); goto *handlers[static_cast<uint8_t>(insn->opcode)]
+
+#define NIFPARSE_INVALID_4 &&handle_invalid, &&handle_invalid, &&handle_invalid, &&handle_invalid
+#define NIFPARSE_INVALID_16 NIFPARSE_INVALID_4, NIFPARSE_INVALID_4, NIFPARSE_INVALID_4, NIFPARSE_INVALID_4
+
+		// Indexed by opcode. Type opcodes only reach plans through LOAD_TYPE, and the remaining compound opcodes are resolved when the plan is compiled.
+		static const void *const handlers[256] = {
+			/* 0 */ NIFPARSE_INVALID_16,
+			/* 16 */ NIFPARSE_INVALID_4, &&handle_IS_NIOBJECT, &&handle_INHERIT, &&handle_invalid, &&handle_invalid,
+			/* 24 */ &&handle_SPECIALIZE, &&handle_FIELD, &&handle_TEMPLATE_ARGUMENT, &&handle_STATIC_ARRAY,
+			/* 28 */ &&handle_DYNAMIC_ARRAY, &&handle_FIELD_INDIRECTION, &&handle_FIELD_VALUE, &&handle_LITERAL,
+			/* 32 */ &&handle_NOT, &&handle_MUL, &&handle_DIV, &&handle_MOD,
+			/* 36 */ &&handle_ADD, &&handle_SUB, &&handle_LSHIFT, &&handle_RSHIFT,
+			/* 40 */ &&handle_LESSTHAN, &&handle_LESSOREQUAL, &&handle_GREATERTHAN, &&handle_GREATEROREQUAL,
+			/* 44 */ &&handle_EQUAL, &&handle_NOTEQUAL, &&handle_BITAND, &&handle_XOR,
+			/* 48 */ &&handle_BITOR, &&handle_LOGAND, &&handle_LOGOR, &&handle_HEADER_FIELD,
+			/* 52 */ &&handle_CONDITION, &&handle_ARG, &&handle_SETARG, &&handle_invalid,
+			/* 56 */ NIFPARSE_INVALID_4,
+			/* 60 */ &&handle_DUP, &&handle_BRANCHUNLESS, &&handle_BRANCHIF, &&handle_BRANCH,
+			/* 64 */ &&handle_FIELD_DEFAULT, &&handle_invalid, &&handle_invalid, &&handle_invalid,
+			/* 68 */ NIFPARSE_INVALID_4, NIFPARSE_INVALID_4, NIFPARSE_INVALID_4,
+			/* 80 */ NIFPARSE_INVALID_16, NIFPARSE_INVALID_16, NIFPARSE_INVALID_16,
+			/* 128 */ &&handle_LOAD_TYPE, &&handle_SPECIALIZE_TEMPLATE_ARGUMENT, &&handle_invalid, &&handle_FIELD_NUMBER,
+			/* 132 */ NIFPARSE_INVALID_4, NIFPARSE_INVALID_4, NIFPARSE_INVALID_4,
+			/* 144 */ NIFPARSE_INVALID_16, NIFPARSE_INVALID_16, NIFPARSE_INVALID_16,
+			/* 192 */ NIFPARSE_INVALID_16, NIFPARSE_INVALID_16, NIFPARSE_INVALID_16,
+			/* 240 */ NIFPARSE_INVALID_4, NIFPARSE_INVALID_4, NIFPARSE_INVALID_4,
+			/* 252 */ &&handle_invalid, &&handle_invalid, &&handle_invalid, &&handle_END
+		};
+
+#undef NIFPARSE_INVALID_16
+#undef NIFPARSE_INVALID_4
+
+		NIFPARSE_DISPATCH();
+#else
+#define NIFPARSE_HANDLER(name) case Opcode::name:
+#define NIFPARSE_INVALID_HANDLER default:
+#define NIFPARSE_DISPATCH() continue
+
+		for (;;) {
+			insn = next++;
+			NIFPARSE_COUNT();
+
+			switch (insn->opcode) {
+#endif
+
+#define NIFPARSE_BINARY_HANDLER(name, expression) \
+			NIFPARSE_HANDLER(name) \
+			{ \
+				auto right = stack.popNumber(); \
+				auto &left = stack.topNumber(); \
+				left = static_cast<uint32_t>(expression); \
+				NIFPARSE_DISPATCH(); \
+			}
 
-			switch (op) {
-			case Opcode::INHERIT:
+			NIFPARSE_HANDLER(INHERIT)
 			{
-				TypeDescription inheritedType;
-				auto inheritedOp = static_cast<Opcode>(m_bytecodeReader.readByte());
-				if (!inheritedType.parse(inheritedOp, m_bytecodeReader)) {
-					std::stringstream error;
-					error << "Unable to parse compound parent type, opcode " << static_cast<unsigned int>(inheritedOp);
-					throw std::runtime_error(error.str());
-				}
-
-				if (inheritedType.type() != TypeDescription::Type::NamedType) {
-					throw std::logic_error("Compound types should only inherit other compound types");
-				}
-
-				Serializer baseSerializer(m_mode, inheritedType.typeName(), m_value);
+				Serializer baseSerializer(m_mode, ctx.plans().plan(Symbol(insn->operand)), m_value);
+				baseSerializer.m_projection = m_projection;
+				baseSerializer.m_visitor = m_visitor;
+				baseSerializer.m_derived = this;
 				baseSerializer.execute(ctx);
-				break;
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::IS_NIOBJECT:
-				if (m_mode == Mode::Deserialize) {
+			NIFPARSE_HANDLER(IS_NIOBJECT)
+				if (m_mode != Mode::Serialize) {
 					dictionary.isNiObject = true;
 				}
 
-				break;
+				NIFPARSE_DISPATCH();
 
-			case Opcode::IS_TEMPLATE:
-				description.setIsTemplate();
-				break;
-
-			case Opcode::SPECIALIZE:
-			{
-				auto specializationOp = static_cast<Opcode>(m_bytecodeReader.readByte());
-				if (specializationOp == Opcode::TEMPLATE_ARGUMENT) {
-					if (!m_specialization)
-						throw std::runtime_error("template type is not specialized");
+			NIFPARSE_HANDLER(LOAD_TYPE)
+				description = m_plan.typeDescription(insn->operand);
+				NIFPARSE_DISPATCH();
 
-					description.specialization() = *m_specialization;
-				}
-				else {
-					if (!description.specialization().parse(specializationOp, m_bytecodeReader)) {
-						std::stringstream error;
-						error << "Unable to parse specialization, opcode " << static_cast<unsigned int>(specializationOp);
-						throw std::runtime_error(error.str());
-					}
-				}
+			NIFPARSE_HANDLER(SPECIALIZE)
+				description.setSpecialization(&m_plan.typeDescription(insn->operand));
+				NIFPARSE_DISPATCH();
 
-				break;
-			}
+			NIFPARSE_HANDLER(SPECIALIZE_TEMPLATE_ARGUMENT)
+				if (!m_specialization)
+					throw std::runtime_error("template type is not specialized");
 
+				description.setSpecialization(m_specialization);
+				NIFPARSE_DISPATCH();
 
-			case Opcode::FIELD:
+			NIFPARSE_HANDLER(FIELD)
 			{
-				Symbol fieldName(m_bytecodeReader.readVarInt());
+				Symbol fieldName(insn->operand);
 
 				if (fieldPresent) {
-					if (m_mode == Mode::Deserialize) {
+					if (m_mode != Mode::Serialize && !readsField(fieldName)) {
+						description.skipValue(ctx);
+					}
+					else if (m_mode == Mode::Visit && !retainsField(fieldName)) {
+						description.visitValue(ctx, *m_visitor, fieldName);
+					}
+					else if (m_mode != Mode::Serialize) {
 						auto value = description.readValue(ctx);
+
+						if (m_mode == Mode::Visit && reportsField(fieldName)) {
+							m_visitor->visitValue(fieldName, value);
+						}
+
 						auto result = dictionary.data.try_emplace(fieldName, std::move(value));
 						if (!result.second) {
 							result.first->second = std::move(value);
@@ -161,20 +325,25 @@ namespace nifparse {
 				}
 				fieldPresent = true;
 				description.reset();
-				break;
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::FIELD_DEFAULT:
+			NIFPARSE_HANDLER(FIELD_DEFAULT)
 			{
-				Symbol fieldName(m_bytecodeReader.readVarInt());
+				Symbol fieldName(insn->operand);
+				const auto &defaultValue = m_plan.defaultValue(insn->operand2);
 
-				size_t dataLength = m_bytecodeReader.readVarInt();
-				auto data = m_bytecodeReader.readBytes(dataLength);
-
-				if (m_mode == Mode::Deserialize) {
-					ConstantDataStream defaultStream(data, dataLength);
+				if (m_mode != Mode::Serialize && readsField(fieldName)) {
+					ConstantDataStream defaultStream(defaultValue.data, defaultValue.length);
 					SerializerContext defaultContext(ctx.header, defaultStream, true);
+					defaultContext.setPlans(ctx.plans());
+					defaultContext.setUseNativeCode(ctx.useNativeCode());
 					auto value = description.readValue(defaultContext);
+
+					if (m_mode == Mode::Visit && reportsField(fieldName)) {
+						m_visitor->visitValue(fieldName, value);
+					}
+
 					auto result = dictionary.data.try_emplace(fieldName, std::move(value));
 					if (!result.second) {
 						result.first->second = std::move(value);
@@ -183,30 +352,25 @@ namespace nifparse {
 
 				fieldPresent = true;
 				description.reset();
-				break;
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::TEMPLATE_ARGUMENT:
+			NIFPARSE_HANDLER(TEMPLATE_ARGUMENT)
 				if (!m_specialization)
 					throw std::runtime_error("template type is not specialized");
 
 				description = *m_specialization;
-				break;
-
-			case Opcode::STATIC_ARRAY:
-				description.addArrayDimension(m_bytecodeReader.readVarInt());
-				break;
-
-			case Opcode::DYNAMIC_ARRAY:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
+				NIFPARSE_DISPATCH();
 
-				description.addArrayDimension(m_stack.back());
-				m_stack.pop_back();
+			NIFPARSE_HANDLER(STATIC_ARRAY)
+				description.addArrayDimension(insn->operand);
+				NIFPARSE_DISPATCH();
 
-				break;
+			NIFPARSE_HANDLER(DYNAMIC_ARRAY)
+				description.addArrayDimension(std::move(stack.pop()));
+				NIFPARSE_DISPATCH();
 
-			case Opcode::FIELD_INDIRECTION:
+			NIFPARSE_HANDLER(FIELD_INDIRECTION)
 			{
 				NIFDictionary *dict;
 				if(indirectionStack.empty())
@@ -216,7 +380,7 @@ namespace nifparse {
 					indirectionStack.pop_back();
 				}
 
-				Symbol fieldName(m_bytecodeReader.readVarInt());
+				Symbol fieldName(insn->operand);
 				auto it = dict->data.find(fieldName);
 				if (it == dict->data.end()) {
 					std::stringstream error;
@@ -225,10 +389,11 @@ namespace nifparse {
 				}
 
 				indirectionStack.push_back(&it->second);
-				break;
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::FIELD_VALUE:
+			NIFPARSE_HANDLER(FIELD_VALUE)
+			NIFPARSE_HANDLER(FIELD_NUMBER)
 			{
 				NIFDictionary *dict;
 				if (indirectionStack.empty())
@@ -238,170 +403,152 @@ namespace nifparse {
 					indirectionStack.pop_back();
 				}
 
-				Symbol fieldName(m_bytecodeReader.readVarInt());
+				Symbol fieldName(insn->operand);
 				auto it = dict->data.find(fieldName);
 				if (it == dict->data.end()) {
 					if (fieldName.isTypeName()) {
 						if (std::find(dict->typeChain.begin(), dict->typeChain.end(), fieldName) == dict->typeChain.end()) {
-							m_stack.push_back(0);
+							stack.push(0U);
 						}
 						else {
-							m_stack.push_back(1);
+							stack.push(1U);
 						}
 					}
 					else {
-						m_stack.push_back(0);
+						stack.push(0U);
 					}
 				}
+				else if (insn->opcode == Opcode::FIELD_NUMBER) {
+					stack.push(numberForStack(fieldName, it->second));
+				}
 				else {
-					m_stack.push_back(coerceForStack(it->second));
+					stack.push(coerceForStack(it->second));
 				}
-				break;
+				NIFPARSE_DISPATCH();
+			}
+
+			NIFPARSE_HANDLER(LITERAL)
+				stack.push(insn->operand);
+				NIFPARSE_DISPATCH();
+
+			NIFPARSE_HANDLER(NOT)
+			{
+				auto &value = stack.topNumber();
+				value = value == 0;
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::LITERAL:
-				m_stack.push_back(m_bytecodeReader.readVarInt());
-				break;
-
-					
-			case Opcode::NOT:
-				executeUnary(op);
-				break;
-
-			case Opcode::MUL:
-			case Opcode::DIV:
-			case Opcode::MOD:
-			case Opcode::ADD:
-			case Opcode::SUB:
-			case Opcode::LSHIFT:
-			case Opcode::RSHIFT:
-			case Opcode::LESSTHAN:
-			case Opcode::LESSOREQUAL:
-			case Opcode::GREATERTHAN:
-			case Opcode::GREATEROREQUAL:
-			case Opcode::EQUAL:
-			case Opcode::NOTEQUAL:
-			case Opcode::BITAND:
-			case Opcode::XOR:
-			case Opcode::BITOR:
-			case Opcode::LOGAND:
-			case Opcode::LOGOR:
-				executeBinary(op);
-				break;
-
-			case Opcode::HEADER_FIELD:
+			// These must agree with evaluateBinary, which folds constant expressions when plans are specialized.
+			NIFPARSE_BINARY_HANDLER(MUL, left * right)
+			NIFPARSE_BINARY_HANDLER(DIV, left / right)
+			NIFPARSE_BINARY_HANDLER(MOD, left % right)
+			NIFPARSE_BINARY_HANDLER(ADD, left + right)
+			NIFPARSE_BINARY_HANDLER(SUB, left - right)
+			NIFPARSE_BINARY_HANDLER(LSHIFT, left << right)
+			NIFPARSE_BINARY_HANDLER(RSHIFT, left >> right)
+			NIFPARSE_BINARY_HANDLER(LESSTHAN, left < right)
+			NIFPARSE_BINARY_HANDLER(LESSOREQUAL, left <= right)
+			NIFPARSE_BINARY_HANDLER(GREATERTHAN, left > right)
+			NIFPARSE_BINARY_HANDLER(GREATEROREQUAL, left >= right)
+			NIFPARSE_BINARY_HANDLER(EQUAL, left == right)
+			NIFPARSE_BINARY_HANDLER(NOTEQUAL, left != right)
+			NIFPARSE_BINARY_HANDLER(BITAND, left & right)
+			NIFPARSE_BINARY_HANDLER(XOR, left ^ right)
+			NIFPARSE_BINARY_HANDLER(BITOR, left | right)
+			NIFPARSE_BINARY_HANDLER(LOGAND, left && right)
+			NIFPARSE_BINARY_HANDLER(LOGOR, left || right)
+
+			NIFPARSE_HANDLER(HEADER_FIELD)
 			{
-				Symbol fieldName(m_bytecodeReader.readVarInt());
 				auto &header = std::get<NIFDictionary>(ctx.header).data;
-				auto it = header.find(fieldName);
-				if (it == header.end() && fieldName == Symbol("Version")) {
-					it = header.find(Symbol("Header String"));
+				auto it = header.find(Symbol(insn->operand));
+				if (it == header.end() && !Symbol(insn->operand2).isNull()) {
+					it = header.find(Symbol(insn->operand2));
 				}
 
 				if (it == header.end()) {
 					std::stringstream error;
-					error << "Required field is not in dictionary: " << fieldName.toString();
+					error << "Required field is not in dictionary: " << Symbol(insn->operand).toString();
 					throw std::runtime_error(error.str());
 				}
 
-				m_stack.push_back(std::get<uint32_t>(it->second));
-				break;
+				stack.push(std::get<uint32_t>(it->second));
+				NIFPARSE_DISPATCH();
 			}
 
-			case Opcode::CONDITION:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
-
-				fieldPresent = std::get<uint32_t>(m_stack.back()) != 0;
-				m_stack.pop_back();
-				break;
-
-			case Opcode::ARG:
-				m_stack.push_back(m_arg);
-				break;
-
-			case Opcode::SETARG:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
+			NIFPARSE_HANDLER(CONDITION)
+				fieldPresent = stack.popNumber() != 0;
+				NIFPARSE_DISPATCH();
 
-				description.setArg(std::get<uint32_t>(m_stack.back()));
-				m_stack.pop_back();
-				break;
+			NIFPARSE_HANDLER(ARG)
+				stack.push(m_arg);
+				NIFPARSE_DISPATCH();
 
-			case Opcode::DUP:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
+			NIFPARSE_HANDLER(SETARG)
+				description.setArg(stack.popNumber());
+				NIFPARSE_DISPATCH();
 
-				m_stack.push_back(m_stack.back());
-				break;
+			NIFPARSE_HANDLER(DUP)
+				stack.dup();
+				NIFPARSE_DISPATCH();
 
-			case Opcode::BRANCHUNLESS:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
-
-				{
-					auto displacement = m_bytecodeReader.readU16();
-					auto value = m_stack.back();
-					m_stack.pop_back();
-
-					if (std::get<uint32_t>(value) == 0) {
-						m_bytecodeReader.branch(static_cast<int>(displacement) - 2);
-					}
+			NIFPARSE_HANDLER(BRANCHUNLESS)
+				if (stack.popNumber() == 0) {
+					next = instructions + insn->operand;
 				}
-				break;
-
-			case Opcode::BRANCHIF:
-				if (m_stack.empty())
-					throw std::runtime_error("stack underflow");
-
-				{
-					auto displacement = m_bytecodeReader.readU16();
-					auto value = m_stack.back();
-					m_stack.pop_back();
+				NIFPARSE_DISPATCH();
 
-					if (std::get<uint32_t>(value) != 0) {
-						m_bytecodeReader.branch(static_cast<int>(displacement) - 2);
-					}
+			NIFPARSE_HANDLER(BRANCHIF)
+				if (stack.popNumber() != 0) {
+					next = instructions + insn->operand;
 				}
-				break;
+				NIFPARSE_DISPATCH();
 
-			case Opcode::BRANCH:
-				{
-					auto displacement = m_bytecodeReader.readU16();
-					m_bytecodeReader.branch(static_cast<int>(displacement) - 2);
-				}
-				break;
+			NIFPARSE_HANDLER(BRANCH)
+				next = instructions + insn->operand;
+				NIFPARSE_DISPATCH();
 
+			NIFPARSE_HANDLER(END)
+#ifdef NIFPARSE_INTERPRETER_STATS
+				instructionsExecuted += executed;
+#endif
+				return;
 
-			case Opcode::END:
-				break;
+			NIFPARSE_INVALID_HANDLER
+			{
+				std::stringstream error;
+				error << "Unknown opcode " << static_cast<unsigned int>(insn->opcode);
+				throw std::runtime_error(error.str());
+			}
 
-			default:
-				if(!description.parse(op, m_bytecodeReader)) {
-					std::stringstream error;
-					error << "Unknown opcode " << static_cast<unsigned int>(op);
-					throw std::runtime_error(error.str());
-				}
+#ifndef NIFPARSE_THREADED_DISPATCH
 			}
-		} while (op != Opcode::END);
+		}
+#endif
+
+#undef NIFPARSE_THREADED_DISPATCH
+#undef NIFPARSE_COUNT
+#undef NIFPARSE_BINARY_HANDLER
+#undef NIFPARSE_DISPATCH
+#undef NIFPARSE_INVALID_HANDLER
+#undef NIFPARSE_HANDLER
 	}
 
-	void Serializer::executeEnum(SerializerContext &ctx, Opcode startOpcode) {
-		TypeDescription storageType;
-
-		auto storageOp = static_cast<Opcode>(m_bytecodeReader.readByte());
-		if (!storageType.parse(storageOp, m_bytecodeReader)) {
-			std::stringstream error;
-			error << "Unable to parse enum storage type, opcode " << static_cast<unsigned int>(storageOp);
-			throw std::runtime_error(error.str());
-		}
+	void Serializer::executeEnum(SerializerContext &ctx) {
+		const auto &storageType = m_plan.storageType();
+		bool isBitflags = m_plan.kind() == TypePlan::Kind::Bitflags;
 
 		uint32_t physicalValue = 0;
 
+		if (m_mode == Mode::Measure) {
+			storageType.skipValue(ctx);
+			return;
+		}
+
 		if (m_mode == Mode::Deserialize) {
 			physicalValue = std::get<uint32_t>(storageType.readValue(ctx));
 
-			if (startOpcode == Opcode::BITFLAGS) {
+			if (isBitflags) {
 				m_value = NIFBitflags();
 				std::get<NIFBitflags>(m_value).rawValue = physicalValue;
 			}
@@ -411,61 +558,40 @@ namespace nifparse {
 			}
 		}
 		
-		Opcode op;
+		for (const auto &option : m_plan.options()) {
+			auto name = option.name;
+			auto value = option.value;
 
-		do {
-			op = static_cast<Opcode>(m_bytecodeReader.readByte());
-
-			switch (op) {
-			case Opcode::OPTION:
-			{
-				Symbol name(m_bytecodeReader.readVarInt());
-				auto value = m_bytecodeReader.readVarInt();
-
-				if (startOpcode == Opcode::BITFLAGS) {
-					if (m_mode == Mode::Deserialize) {
-						if (physicalValue & (1 << value)) {
-							std::get<NIFBitflags>(m_value).symbolicValues.push_back(name);
-						}
+			if (isBitflags) {
+				if (m_mode == Mode::Deserialize) {
+					if (physicalValue & (1 << value)) {
+						std::get<NIFBitflags>(m_value).symbolicValues.push_back(name);
 					}
-					else if (m_mode == Mode::Serialize) {
-						for (const auto &sym : std::get<NIFBitflags>(m_value).symbolicValues) {
-							if (sym == name) {
-								physicalValue |= (1 << value);
-							}
+				}
+				else if (m_mode == Mode::Serialize) {
+					for (const auto &sym : std::get<NIFBitflags>(m_value).symbolicValues) {
+						if (sym == name) {
+							physicalValue |= (1 << value);
 						}
 					}
 				}
-				else {
-					if (m_mode == Mode::Deserialize) {
-						if (physicalValue == value) {
-							std::get<NIFEnum>(m_value).symbolicValue = name;
-						}
+			}
+			else {
+				if (m_mode == Mode::Deserialize) {
+					if (physicalValue == value) {
+						std::get<NIFEnum>(m_value).symbolicValue = name;
 					}
-					else if (m_mode == Mode::Serialize) {
-						if (std::get<NIFEnum>(m_value).symbolicValue == name) {
-							physicalValue = value;
-						}
+				}
+				else if (m_mode == Mode::Serialize) {
+					if (std::get<NIFEnum>(m_value).symbolicValue == name) {
+						physicalValue = value;
 					}
 				}
 			}
-
-				break;
-
-			case Opcode::END:
-				break;
-
-			default:
-			{
-				std::stringstream error;
-				error << "Unknown opcode " << static_cast<unsigned int>(op);
-				throw std::runtime_error(error.str());
-			}
-			}
-		} while (op != Opcode::END);
+		}
 
 		if (m_mode == Mode::Serialize) {
-			if (startOpcode == Opcode::ENUM) {
+			if (!isBitflags) {
 				std::get<NIFEnum>(m_value).rawValue = physicalValue;
 			}
 			else {
@@ -476,13 +602,15 @@ namespace nifparse {
 		}
 	}
 
-	void Serializer::executeUnary(Opcode op) {
-		if (m_stack.empty())
-			throw std::runtime_error("stack underflow");
-
-		auto val = std::get<uint32_t>(m_stack.back());
-		m_stack.pop_back();
+	uint64_t Serializer::executedInstructions() {
+#ifdef NIFPARSE_INTERPRETER_STATS
+		return instructionsExecuted;
+#else
+		return 0;
+#endif
+	}
 
+	uint32_t Serializer::evaluateUnary(Opcode op, uint32_t val) {
 		uint32_t result;
 
 		switch (op) {
@@ -493,20 +621,10 @@ namespace nifparse {
 			throw std::logic_error("unsupported unary opcode");
 		}
 
-		m_stack.push_back(result);
-
+		return result;
 	}
 
-	void Serializer::executeBinary(Opcode op) {
-		if (m_stack.size() < 2)
-			throw std::runtime_error("stack underflow");
-
-		auto right = std::get<uint32_t>(m_stack.back());
-		m_stack.pop_back();
-
-		auto left = std::get<uint32_t>(m_stack.back());
-		m_stack.pop_back();
-
+	uint32_t Serializer::evaluateBinary(Opcode op, uint32_t left, uint32_t right) {
 		uint32_t result;
 
 		switch (op) {
@@ -521,6 +639,7 @@ namespace nifparse {
 
 		case Opcode::MOD:
 			result = left % right;
+			break;
 
 		case Opcode::ADD:
 			result = left + right;
@@ -586,29 +705,62 @@ namespace nifparse {
 			throw std::logic_error("unsupported unary opcode");
 		}
 
-		m_stack.push_back(result);
+		return result;
 	}
 
-	StackValue Serializer::coerceForStack(const NIFVariant &value) {
-		auto enumval = std::get_if<NIFEnum>(&value);
-		
-		if(enumval) {
-			return enumval->rawValue;
+	bool Serializer::retainsField(Symbol name) const {
+		const auto &fields = m_plan.referencedFields();
+		if (std::find(fields.begin(), fields.end(), name) != fields.end())
+			return true;
+
+		return m_derived && m_derived->retainsField(name);
+	}
+
+	bool Serializer::reportsField(Symbol name) const {
+		return !m_projection || m_projection->count(name) != 0;
+	}
+
+	bool Serializer::readsField(Symbol name) const {
+		switch (m_mode) {
+		case Mode::Deserialize:
+		case Mode::Visit:
+			return reportsField(name) || retainsField(name);
+
+		case Mode::Measure:
+			return retainsField(name);
+
+		default:
+			return true;
 		}
-		else {
-			auto bitval = std::get_if<NIFBitflags>(&value);
-			if (bitval) {
-				return bitval->rawValue;
+	}
+
+	uint32_t Serializer::numberForStack(Symbol fieldName, const NIFVariant &value) {
+		auto stackValue = coerceForStack(value);
+		if (auto number = std::get_if<uint32_t>(&stackValue))
+			return *number;
+
+		std::stringstream error;
+		error << "Field " << fieldName.toString() << " is used as a number, but holds an array";
+		throw std::runtime_error(error.str());
+	}
+
+	StackValue Serializer::coerceForStack(const NIFVariant &value) {
+		return std::visit([](auto &&val) -> StackValue {
+			using T = std::decay_t<decltype(val)>;
+
+			if constexpr (std::is_same_v<T, NIFEnum> || std::is_same_v<T, NIFBitflags>) {
+				return val.rawValue;
+			}
+			else if constexpr (std::is_same_v<T, uint32_t>) {
+				return val;
+			}
+			else if constexpr (std::is_same_v<T, NIFArray> || std::is_same_v<T, NIFVector<uint16_t>> ||
+				std::is_same_v<T, NIFVector<int16_t>> || std::is_same_v<T, NIFVector<uint32_t>>) {
+				return &val;
 			}
 			else {
-				auto stackval = std::get_if<NIFArray>(&value);
-				if (stackval) {
-					return *stackval;
-				}
-				else {
-					return std::get<uint32_t>(value);
-				}
+				throw std::bad_variant_access();
 			}
-		}
+		}, value);
 	}
 }
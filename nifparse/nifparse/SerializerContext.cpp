@@ -1,9 +1,91 @@
 #include <nifparse/SerializerContext.h>
+#include <nifparse/INIFDataStream.h>
+#include <nifparse/TypePlanCache.h>
+#include <nifparse/NativeDeserializer.h>
+
+#include <algorithm>
+#include <stdexcept>
 
 namespace nifparse {
-	SerializerContext::SerializerContext(NIFVariant &header, INIFDataStream &stream, bool useConstantLengths) : header(header), m_stream(stream), m_useConstantLengths(useConstantLengths) {
+	SerializerContext::SerializerContext(NIFVariant &header, INIFDataStream &stream, bool useConstantLengths) :
+		header(header),
+		m_stream(stream),
+		m_useConstantLengths(useConstantLengths),
+		m_plans(&TypePlanCache::instance()),
+		m_useNativeCode(true),
+		m_windowBegin(nullptr),
+		m_cursor(nullptr),
+		m_end(nullptr),
+		m_windowPosition(0),
+		m_windowCoversStream(stream.windowCoversStream()) {
+
+		acquireWindow();
+	}
+
+	SerializerContext::~SerializerContext() {
+		sync();
+	}
+
+	NativeDeserializerFunction SerializerContext::nativeDeserializer(Symbol type) const {
+		if (!m_useNativeCode)
+			return nullptr;
+
+		return NativeDeserializer::find(type);
+	}
+
+	void SerializerContext::acquireWindow() {
+		size_t size;
+		m_windowBegin = m_stream.window(size);
+		m_cursor = m_windowBegin;
+		m_end = m_windowBegin ? m_windowBegin + size : nullptr;
+		m_windowPosition = m_windowBegin ? m_stream.position() : 0;
+	}
 
+	void SerializerContext::sync() {
+		if (m_windowBegin && m_cursor != m_windowBegin) {
+			m_stream.seek(m_windowPosition + (m_cursor - m_windowBegin));
+		}
 	}
 
-	SerializerContext::~SerializerContext() = default;
+	void SerializerContext::readBytesSlow(unsigned char *bytes, size_t size) {
+		if (!m_windowBegin) {
+			m_stream.readBytes(bytes, size);
+			return;
+		}
+
+		while (size != 0) {
+			size_t chunk = std::min<size_t>(size, m_end - m_cursor);
+			if (chunk == 0) {
+				sync();
+				acquireWindow();
+
+				if (m_cursor == m_end)
+					throw std::runtime_error("read is out of bounds");
+
+				continue;
+			}
+
+			memcpy(bytes, m_cursor, chunk);
+			m_cursor += chunk;
+			bytes += chunk;
+			size -= chunk;
+		}
+	}
+
+	size_t SerializerContext::position() const {
+		if (m_windowBegin)
+			return m_windowPosition + (m_cursor - m_windowBegin);
+		else
+			return m_stream.position();
+	}
+
+	void SerializerContext::seek(size_t position) {
+		if (m_windowBegin && position >= m_windowPosition && position <= m_windowPosition + (m_end - m_windowBegin)) {
+			m_cursor = m_windowBegin + (position - m_windowPosition);
+		}
+		else {
+			m_stream.seek(position);
+			acquireWindow();
+		}
+	}
 }
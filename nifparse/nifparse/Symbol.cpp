@@ -43,5 +43,9 @@ namespace nifparse {
 		return Symbol(reader.readVarInt());
 	}
 
+	size_t Symbol::count() {
+		return m_symbolTable.symbolCount();
+	}
+
 	SymbolTable Symbol::m_symbolTable;
 }
@@ -1,86 +1,71 @@
 #include <nifparse/SymbolTable.h>
-#include <nifparse/BytecodeReader.h>
+#include <nifparse/bytecode.h>
 
 #include <sstream>
+#include <stdexcept>
+#include <string.h>
 
 namespace nifparse {
-	SymbolTable::SymbolTable() {
-		BytecodeReader reader(0);
-		auto typeArraySize = reader.readVarInt();
-		
-		m_typeOffsetMap.reserve(typeArraySize);
-		for (size_t index = 0; index < typeArraySize; index++) {
-			auto typeId = reader.readVarInt();
-			auto typeOffset = reader.readVarInt();
-			m_typeOffsetMap.emplace(Symbol(typeId), typeOffset);
-		}
-
-		auto symbolArrayBytes = reader.readVarInt();
-		auto symbolCount = reader.readVarInt();
-
-		m_bytecodeStartOffset = reader.position() + symbolArrayBytes;
-
-		m_symbolStrings.reserve(symbolCount);
-		m_symbolLookup.reserve(symbolCount);
-		for (size_t index = 0; index < symbolCount; index++) {
-			auto string = reader.readAsciiz();
+	static const uint32_t NotAType = 0xFFFFFFFF;
 
-			m_symbolStrings.emplace_back(string);
-			m_symbolLookup.emplace(string, static_cast<uint32_t>(index));
-		}
-	}
+	uint32_t SymbolTable::lookupSymbol(const char *string) const {
+		// A negative displacement places the only string of its bucket directly; others seed the second hash.
+		auto displacement = nifSymbolHashDisplacements[hashString(0, string) % nifSymbolCount];
 
-	SymbolTable::~SymbolTable() = default;
+		uint32_t slot;
+		if (displacement < 0)
+			slot = static_cast<uint32_t>(-displacement - 1);
+		else
+			slot = hashString(static_cast<uint32_t>(displacement), string) % nifSymbolCount;
 
-	uint32_t SymbolTable::lookupSymbol(const char *string) const {
-		auto it = m_symbolLookup.find(string);
+		auto symbol = nifSymbolHashSlots[slot];
 
-		if (it == m_symbolLookup.end()) {
+		if (strcmp(nifSymbolStrings[symbol], string) != 0) {
 			std::stringstream error;
 			error << "Symbol not found: " << string;
 			throw std::runtime_error(error.str());
 		}
 
-		return it->second;
-	}
-
-	bool SymbolTable::SymbolLookupEqual::operator()(const char *string1, const char *string2) const {
-		return strcmp(string1, string2) == 0;
+		return symbol;
 	}
 
 	const char *SymbolTable::symbolToString(uint32_t value) const {
 		if (value == 0xFFFFFFFF)
 			return "<NIL>";
 		else
-			return m_symbolStrings[value];
+			return nifSymbolStrings[value];
 	}
 
-	size_t SymbolTable::SymbolLookupHash::operator()(const char *string) const {
-		size_t i = 0;
-		uint32_t hash = 0;
+	uint32_t SymbolTable::hashString(uint32_t seed, const char *string) {
+		uint32_t hash = 0x811C9DC5U ^ (seed * 0x9E3779B9U);
 		while (*string) {
-			hash += *string++;
-			hash += hash << 10;
-			hash ^= hash >> 6;
+			hash ^= static_cast<unsigned char>(*string++);
+			hash *= 0x01000193U;
 		}
-		hash += hash << 3;
-		hash ^= hash >> 11;
-		hash += hash << 15;
+
+		hash ^= hash >> 16;
+		hash *= 0x85EBCA6BU;
+		hash ^= hash >> 13;
+		hash *= 0xC2B2AE35U;
+		hash ^= hash >> 16;
 		return hash;
 	}
 
 	size_t SymbolTable::bytecodeStartOffset(const Symbol &symbol) const {
-		auto it = m_typeOffsetMap.find(symbol);
-		if (it == m_typeOffsetMap.end()) {
+		if (!isTypeName(symbol)) {
 			std::stringstream error;
 			error << "Symbol does not represent a type: " << symbol.toString();
 			throw std::runtime_error(error.str());
 		}
 
-		return m_bytecodeStartOffset + it->second;
+		return nifSymbolTypeOffsets[symbol];
 	}
 
 	bool SymbolTable::isTypeName(const Symbol &symbol) const {
-		return m_typeOffsetMap.count(symbol) != 0;
+		return symbol < nifSymbolCount && nifSymbolTypeOffsets[symbol] != NotAType;
+	}
+
+	size_t SymbolTable::symbolCount() const {
+		return nifSymbolCount;
 	}
 }
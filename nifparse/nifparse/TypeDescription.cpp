@@ -1,45 +1,52 @@
 #include <nifparse/TypeDescription.h>
+#include <nifparse/NIFVisitor.h>
 #include <nifparse/SerializerContext.h>
+#include <nifparse/Symbols.h>
 #include <nifparse/BytecodeReader.h>
 #include <nifparse/Serializer.h>
-#include <nifparse/INIFDataStream.h>
+#include <nifparse/TypePlanCache.h>
+#include <nifparse/TypePlan.h>
 
 #include <half.h>
 
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <regex>
+#include <tuple>
 
 namespace nifparse {
 	static const std::regex fileVersionRegex1("^NetImmerse File Format, Version ([0-9]+)\\.([0-9]+)\\.([0-9]+)\\.([0-9]+)$");
 	static const std::regex fileVersionRegex2("^Gamebryo File Format, Version ([0-9]+)\\.([0-9]+)\\.([0-9]+)\\.([0-9]+)$");
 	
-	TypeDescription::TypeDescription(SpecializationMarker) : m_type(Type::Null), m_arg(0), m_isTemplate(false) {
+	TypeDescription::TypeDescription() : m_type(Type::Null), m_dimensionCount(0), m_arg(0), m_specialization(nullptr) {
 
 	}
 
-	TypeDescription::TypeDescription() : m_type(Type::Null), m_arg(0), m_specialization(new TypeDescription(Specialization)) {
+	TypeDescription::TypeDescription(Type type, Symbol typeName) : m_type(type), m_dimensionCount(0), m_typeName(typeName), m_arg(0), m_specialization(nullptr) {
 
 	}
 
 	TypeDescription::~TypeDescription() = default;
 
-	TypeDescription::TypeDescription(const TypeDescription &other) : m_type(Type::Null), m_arg(0), m_isTemplate(false) {
-		*this = other;
-	}
-	
-	TypeDescription &TypeDescription::operator =(const TypeDescription &other) {
-		m_type = other.m_type;
-		m_dimensions = other.m_dimensions;
-		m_typeName = other.m_typeName;
-		m_arg = other.m_arg;
-		if (other.m_specialization) {
-			m_specialization = std::make_unique<TypeDescription>(*other.m_specialization);
-		}
-		else {
-			m_specialization.reset();
-		}
-		m_isTemplate = other.m_isTemplate;
-		return *this;
+	TypeDescription::TypeDescription(const TypeDescription &other) = default;
+
+	TypeDescription &TypeDescription::operator =(const TypeDescription &other) = default;
+
+	const TypeDescription *TypeDescription::intern(const TypeDescription &description) {
+		if (description.m_dimensionCount != 0)
+			throw std::logic_error("Descriptions with array dimensions cannot be interned");
+
+		using Key = std::tuple<Type, uint32_t, uint32_t, const TypeDescription *>;
+
+		// Plans are compiled from any thread; map nodes stay in place as others are added.
+		static std::mutex mutex;
+		static std::map<Key, TypeDescription> descriptions;
+
+		Key key(description.m_type, description.m_typeName, description.m_arg, description.m_specialization);
+
+		std::unique_lock<std::mutex> locker(mutex);
+		return &descriptions.try_emplace(key, description).first->second;
 	}
 
 	bool TypeDescription::parse(Opcode opcode, BytecodeReader &bytecode) {
@@ -128,26 +135,26 @@ namespace nifparse {
 	}
 
 	void TypeDescription::addArrayDimension(StackValue dimension) {
-		m_dimensions.emplace_back(dimension);
+		if (m_dimensionCount == MaxDimensions)
+			throw std::logic_error("Too many array dimensions");
+
+		m_dimensions[m_dimensionCount++] = dimension;
 	}
 
 	void TypeDescription::reset() {
 		m_type = Type::Null;
-		m_dimensions.clear();
+		m_dimensionCount = 0;
 		m_typeName = Symbol();
 		m_arg = 0;
-		if (m_specialization) {
-			m_specialization->reset();
-		}
-		m_isTemplate = false;
+		m_specialization = nullptr;
 	}
 
-	NIFVariant TypeDescription::readValue(SerializerContext &ctx) {
-		return doReadValue(ctx, static_cast<uint32_t>(~0), m_dimensions.begin());
+	NIFVariant TypeDescription::readValue(SerializerContext &ctx) const {
+		return doReadValue(ctx, static_cast<uint32_t>(~0), m_dimensions);
 	}
 
-	NIFVariant TypeDescription::doReadValue(SerializerContext &ctx, uint32_t outerIndex, std::vector<StackValue>::iterator it) {
-		if (it == m_dimensions.end()) {
+	NIFVariant TypeDescription::doReadValue(SerializerContext &ctx, uint32_t outerIndex, const StackValue *it) const {
+		if (it == dimensionsEnd()) {
 			return readSingleValue(ctx);
 		}
 		else {
@@ -164,29 +171,19 @@ namespace nifparse {
 				throw std::runtime_error("dynamic array size at outer level");
 			}
 			else {
-				arraySize = std::get<uint32_t>(std::get<NIFArray>(*it).data[outerIndex]);
+				arraySize = dimensionElement(*it, outerIndex);
 			}
 
 			NIFVariant value;
 			
-			if (nextIt == m_dimensions.end() && m_type == Type::Byte) {
-				// Byte array
-
-				value = std::vector<unsigned char>(arraySize);
-
-				auto &arrayData = std::get<std::vector<unsigned char>>(value);
+			bool innermost = nextIt == dimensionsEnd();
+			const TypePlan *elementPlan = innermost && m_type == Type::NamedType ? &ctx.plans().plan(m_typeName) : nullptr;
 
-				ctx.stream().readBytes(arrayData.data(), arrayData.size());
+			if (innermost && isPackedArrayType(m_type)) {
+				value = readPackedArray(ctx, m_type, arraySize);
 			}
-			else if (nextIt == m_dimensions.end() && m_type == Type::Char) {
-				// String
-
-				value = std::string();
-
-				auto &arrayData = std::get<std::string>(value);
-
-				arrayData.resize(arraySize);
-				ctx.stream().readBytes(reinterpret_cast<unsigned char *>(arrayData.data()), arrayData.size());
+			else if (elementPlan && elementPlan->structLayout()) {
+				value = readStructArray(ctx, elementPlan->structLayout(), arraySize);
 			}
 			else {
 
@@ -205,7 +202,7 @@ namespace nifparse {
 		}
 	}
 
-	NIFVariant TypeDescription::readSingleValue(SerializerContext &ctx) {
+	NIFVariant TypeDescription::readSingleValue(SerializerContext &ctx) const {
 		NIFVariant value;
 
 		switch (m_type) {
@@ -213,161 +210,45 @@ namespace nifparse {
 			throw std::runtime_error("attempted to read null type");
 
 		case Type::Bool:
-			if (!ctx.useConstantLengths() && std::get<NIFDictionary>(ctx.header).getValue<uint32_t>("Version") > 0x04000002) {
-				union {
-					unsigned char bytes[1];
-					uint8_t val;
-				} u;
-
-				ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-				value = static_cast<uint32_t>(u.val);
-			}
-			else {
-				union {
-					unsigned char bytes[4];
-					uint32_t val;
-				} u;
-
-				ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-				value = u.val;
-			}
-
+			value = readBool(ctx);
 			break;
 
 		case Type::Byte:
-		{
-			union {
-				unsigned char bytes[1];
-				uint8_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
-			break;
-		}
-
 		case Type::Char:
-		{
-			union {
-				char bytes[1];
-				uint8_t val;
-			} u;
-
-			ctx.stream().readBytes(reinterpret_cast<unsigned char *>(u.bytes), sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
+			value = static_cast<uint32_t>(ctx.read<uint8_t>());
 			break;
-		}
 
 		case Type::UInt:
 		case Type::ULittle32:
 		case Type::StringIndex:
 		case Type::StringOffset:
-		{
-			union {
-				unsigned char bytes[4];
-				uint32_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
+			value = ctx.read<uint32_t>();
 			break;
-		}
 
 		case Type::Int:
-		{
-			union {
-				unsigned char bytes[4];
-				int32_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
+			value = static_cast<uint32_t>(ctx.read<int32_t>());
 			break;
-		}
 
 		case Type::Float:
-		{			
-			union {
-				unsigned char bytes[4];
-				float val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = u.val;
+			value = ctx.read<float>();
 			break;
-		}
 
 		case Type::UShort:
 		case Type::Flags:
-		{
-			union {
-				unsigned char bytes[2];
-				uint16_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
+			value = static_cast<uint32_t>(ctx.read<uint16_t>());
 			break;
-		}
 
 		case Type::Short:
-		{
-			union {
-				unsigned char bytes[2];
-				int16_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			value = static_cast<uint32_t>(u.val);
+			value = static_cast<uint32_t>(ctx.read<int16_t>());
 			break;
-		}
 
 		case Type::HeaderString:
-		{
-			std::string headerString;
-			unsigned char byte;
-			do {
-				ctx.stream().readBytes(&byte, 1);
-
-				if (byte != '\n')
-					headerString.push_back(static_cast<char>(byte));
-			} while (byte != '\n');
-
-			std::smatch matches;
-
-			if (!std::regex_match(headerString.cbegin(), headerString.cend(), matches, fileVersionRegex1)) {
-				if (!std::regex_match(headerString.cbegin(), headerString.cend(), matches, fileVersionRegex2)) {
-					throw std::runtime_error("malformed header string. Not a NIF file?");
-				}
-			}
-
-			auto version = (std::stoul(matches[1].str()) << 24) |
-				(std::stoul(matches[2].str()) << 16) |
-				(std::stoul(matches[3].str()) << 8) |
-				(std::stoul(matches[4].str()) << 0);
-
-			value = static_cast<uint32_t>(version);
+			value = readHeaderString(ctx);
 			break;
-		}
-
 
 		case Type::Ref:
-		{			
-			union {
-				unsigned char bytes[4];
-				int32_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
+		{
+			auto target = ctx.read<int32_t>();
 
 			if (!m_specialization || m_specialization->type() != Type::NamedType) {
 				throw std::logic_error("Ref specialization has invalid type");
@@ -375,7 +256,7 @@ namespace nifparse {
 
 			NIFReference ref;
 			ref.type = m_specialization->typeName();
-			ref.target = u.val;
+			ref.target = target;
 
 			value = std::move(ref);
 			break;
@@ -383,12 +264,7 @@ namespace nifparse {
 
 		case Type::Ptr:
 		{
-			union {
-				unsigned char bytes[4];
-				int32_t val;
-			} u;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
+			auto target = ctx.read<int32_t>();
 
 			if (!m_specialization || m_specialization->type() != Type::NamedType) {
 				throw std::logic_error("Ref specialization has invalid type");
@@ -396,36 +272,27 @@ namespace nifparse {
 
 			NIFPointer ref;
 			ref.type = m_specialization->typeName();
-			ref.target = u.val;
+			ref.target = target;
 
 			value = std::move(ref);
 			break;
 		}
 
 		case Type::HFloat:
-		{
-			union {
-				unsigned char bytes[2];
-				uint16_t val;
-			} u;
-
-			union {
-				uint32_t i;
-				float f;
-			} u2;
-
-			ctx.stream().readBytes(u.bytes, sizeof(u.bytes));
-
-			u2.i = half_to_float(u.val);
-			value = u2.f;
+			value = readHalfFloat(ctx);
 			break;
-		}
 
 		case Type::NamedType:
 		{
-			Serializer serializer(Serializer::Mode::Deserialize, m_typeName, value);
+			auto native = ctx.nativeDeserializer(m_typeName);
+			if (native) {
+				native(ctx, value, m_arg, m_specialization);
+				break;
+			}
+
+			Serializer serializer(Serializer::Mode::Deserialize, ctx.plans().plan(m_typeName), value);
 			serializer.setArg(m_arg);
-			serializer.setSpecialization(m_specialization.get());
+			serializer.setSpecialization(m_specialization);
 			serializer.execute(ctx);
 			break;
 		}
@@ -441,13 +308,317 @@ namespace nifparse {
 		return value;
 	}
 
-	void TypeDescription::writeValue(SerializerContext &ctx, const NIFVariant &value) {
-		return doWriteValue(ctx, value, static_cast<uint32_t>(~0), m_dimensions.begin());
+	void TypeDescription::skipValue(SerializerContext &ctx) const {
+		doSkipValue(ctx, static_cast<uint32_t>(~0), m_dimensions);
+	}
+
+	void TypeDescription::doSkipValue(SerializerContext &ctx, uint32_t outerIndex, const StackValue *it) const {
+		if (it == dimensionsEnd()) {
+			skipSingleValue(ctx);
+			return;
+		}
+
+		auto nextIt = it;
+		++nextIt;
+
+		size_t arraySize;
+
+		auto arraySizeInt = std::get_if<uint32_t>(&*it);
+		if (arraySizeInt) {
+			arraySize = *arraySizeInt;
+		}
+		else if (outerIndex == static_cast<uint32_t>(~0)) {
+			throw std::runtime_error("dynamic array size at outer level");
+		}
+		else {
+			arraySize = dimensionElement(*it, outerIndex);
+		}
+
+		if (nextIt == dimensionsEnd()) {
+			auto elementSize = fixedSize(ctx);
+			if (elementSize != 0) {
+				ctx.skipBytes(arraySize * elementSize);
+				return;
+			}
+		}
+
+		for (size_t index = 0; index < arraySize; index++) {
+			doSkipValue(ctx, static_cast<uint32_t>(index), nextIt);
+		}
+	}
+
+	void TypeDescription::skipSingleValue(SerializerContext &ctx) const {
+		auto size = fixedSize(ctx);
+		if (size != 0) {
+			ctx.skipBytes(size);
+			return;
+		}
+
+		if (m_type == Type::NamedType) {
+			NIFVariant value;
+			Serializer serializer(Serializer::Mode::Measure, ctx.plans().plan(m_typeName), value);
+			serializer.setArg(m_arg);
+			serializer.setSpecialization(m_specialization);
+			serializer.execute(ctx);
+		}
+		else {
+			readSingleValue(ctx);
+		}
+	}
+
+	void TypeDescription::visitValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name) const {
+		doVisitValue(ctx, visitor, name, static_cast<uint32_t>(~0), m_dimensions);
+	}
+
+	void TypeDescription::doVisitValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name, uint32_t outerIndex, const StackValue *it) const {
+		if (it == dimensionsEnd()) {
+			visitSingleValue(ctx, visitor, name);
+			return;
+		}
+
+		auto nextIt = it;
+		++nextIt;
+
+		size_t arraySize;
+
+		auto arraySizeInt = std::get_if<uint32_t>(&*it);
+		if (arraySizeInt) {
+			arraySize = *arraySizeInt;
+		}
+		else if (outerIndex == static_cast<uint32_t>(~0)) {
+			throw std::runtime_error("dynamic array size at outer level");
+		}
+		else {
+			arraySize = dimensionElement(*it, outerIndex);
+		}
+
+		bool innermost = nextIt == dimensionsEnd();
+		const TypePlan *elementPlan = innermost && m_type == Type::NamedType ? &ctx.plans().plan(m_typeName) : nullptr;
+
+		// Packed arrays are reported whole, as they are read in one go anyway.
+		if ((innermost && isPackedArrayType(m_type)) || (elementPlan && elementPlan->structLayout())) {
+			visitor.visitValue(name, doReadValue(ctx, outerIndex, it));
+			return;
+		}
+
+		visitor.beginArray(name, arraySize);
+
+		for (size_t index = 0; index < arraySize; index++) {
+			doVisitValue(ctx, visitor, Symbol(), static_cast<uint32_t>(index), nextIt);
+		}
+
+		visitor.endArray();
+	}
+
+	void TypeDescription::visitSingleValue(SerializerContext &ctx, NIFVisitor &visitor, Symbol name) const {
+		if (m_type == Type::NamedType) {
+			const auto &plan = ctx.plans().plan(m_typeName);
+			if (plan.kind() == TypePlan::Kind::Compound) {
+				visitor.beginCompound(name, m_typeName);
+
+				NIFVariant value;
+				Serializer serializer(Serializer::Mode::Visit, plan, value);
+				serializer.setArg(m_arg);
+				serializer.setSpecialization(m_specialization);
+				serializer.setVisitor(&visitor);
+				serializer.execute(ctx);
+
+				visitor.endCompound();
+				return;
+			}
+		}
+
+		visitor.visitValue(name, readSingleValue(ctx));
+	}
+
+	size_t TypeDescription::fixedSize(SerializerContext &ctx) const {
+		switch (m_type) {
+		case Type::Byte:
+		case Type::Char:
+			return 1;
+
+		case Type::UShort:
+		case Type::Flags:
+		case Type::Short:
+		case Type::HFloat:
+			return 2;
+
+		case Type::UInt:
+		case Type::ULittle32:
+		case Type::StringIndex:
+		case Type::StringOffset:
+		case Type::Int:
+		case Type::Float:
+		case Type::Ref:
+		case Type::Ptr:
+			return 4;
+
+		case Type::Bool:
+			return !ctx.useConstantLengths() && std::get<NIFDictionary>(ctx.header).getValue<uint32_t>(symbols::Version) > 0x04000002 ? 1 : 4;
+
+		case Type::NamedType:
+		{
+			const auto &plan = ctx.plans().plan(m_typeName);
+			if (plan.kind() != TypePlan::Kind::Compound)
+				return plan.storageType().fixedSize(ctx);
+			else if (!ctx.useConstantLengths())
+				return plan.fixedSize();
+			else if (plan.structLayout())
+				// The fixed size may count bools at their size in the file, which differs with constant lengths.
+				return plan.structLayout()->stride;
+			else
+				return 0;
+		}
+
+		default:
+			return 0;
+		}
+	}
+
+	template<typename T>
+	static NIFVector<T> readPacked(SerializerContext &ctx, size_t size) {
+		NIFVector<T> data(size);
+		ctx.readBytes(reinterpret_cast<unsigned char *>(data.data()), size * sizeof(T));
+		return data;
+	}
+
+	bool TypeDescription::isPackedArrayType(Type type) {
+		switch (type) {
+		case Type::Bool:
+		case Type::Byte:
+		case Type::Char:
+		case Type::UInt:
+		case Type::ULittle32:
+		case Type::StringIndex:
+		case Type::StringOffset:
+		case Type::Int:
+		case Type::UShort:
+		case Type::Flags:
+		case Type::Short:
+		case Type::Float:
+		case Type::HFloat:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	NIFVariant TypeDescription::readPackedArray(SerializerContext &ctx, Type type, size_t size) {
+		switch (type) {
+		case Type::Byte:
+			return readPacked<unsigned char>(ctx, size);
+
+		case Type::Char:
+		{
+			NIFString string;
+			string.resize(size);
+			ctx.readBytes(reinterpret_cast<unsigned char *>(string.data()), size);
+			return string;
+		}
+
+		case Type::UInt:
+		case Type::ULittle32:
+		case Type::StringIndex:
+		case Type::StringOffset:
+		case Type::Int:
+			// Same bits as the uint32_t a single int is stored as.
+			return readPacked<uint32_t>(ctx, size);
+
+		case Type::UShort:
+		case Type::Flags:
+			return readPacked<uint16_t>(ctx, size);
+
+		case Type::Short:
+			return readPacked<int16_t>(ctx, size);
+
+		case Type::Float:
+			return readPacked<float>(ctx, size);
+
+		case Type::HFloat:
+		{
+			NIFVector<float> data(size);
+			for (auto &element : data) {
+				element = readHalfFloat(ctx);
+			}
+			return data;
+		}
+
+		case Type::Bool:
+		{
+			// Bools are one or four bytes depending on the version, so they cannot be read in bulk.
+			NIFVector<uint32_t> data(size);
+			for (auto &element : data) {
+				element = readBool(ctx);
+			}
+			return data;
+		}
+
+		default:
+			throw std::logic_error("type cannot be read into a packed array");
+		}
+	}
+
+	NIFStructArray TypeDescription::readStructArray(SerializerContext &ctx, const std::shared_ptr<const NIFStructLayout> &layout, size_t size) {
+		NIFStructArray array;
+		array.layout = layout;
+		array.data.resize(size * layout->stride);
+		ctx.readBytes(array.data.data(), array.data.size());
+		return array;
+	}
+
+	uint32_t TypeDescription::readBool(SerializerContext &ctx) {
+		if (!ctx.useConstantLengths() && std::get<NIFDictionary>(ctx.header).getValue<uint32_t>(symbols::Version) > 0x04000002) {
+			return static_cast<uint32_t>(ctx.read<uint8_t>());
+		}
+		else {
+			return ctx.read<uint32_t>();
+		}
+	}
+
+	uint32_t TypeDescription::readHeaderString(SerializerContext &ctx) {
+		std::string headerString;
+		unsigned char byte;
+		do {
+			byte = ctx.read<unsigned char>();
+
+			if (byte != '\n')
+				headerString.push_back(static_cast<char>(byte));
+		} while (byte != '\n');
+
+		std::smatch matches;
+
+		if (!std::regex_match(headerString.cbegin(), headerString.cend(), matches, fileVersionRegex1)) {
+			if (!std::regex_match(headerString.cbegin(), headerString.cend(), matches, fileVersionRegex2)) {
+				throw std::runtime_error("malformed header string. Not a NIF file?");
+			}
+		}
+
+		auto version = (std::stoul(matches[1].str()) << 24) |
+			(std::stoul(matches[2].str()) << 16) |
+			(std::stoul(matches[3].str()) << 8) |
+			(std::stoul(matches[4].str()) << 0);
+
+		return static_cast<uint32_t>(version);
+	}
+
+	float TypeDescription::readHalfFloat(SerializerContext &ctx) {
+		union {
+			uint32_t i;
+			float f;
+		} u2;
+
+		u2.i = half_to_float(ctx.read<uint16_t>());
+		return u2.f;
+	}
+
+	void TypeDescription::writeValue(SerializerContext &ctx, const NIFVariant &value) const {
+		return doWriteValue(ctx, value, static_cast<uint32_t>(~0), m_dimensions);
 	}
 
 
-	void TypeDescription::doWriteValue(SerializerContext &ctx, const NIFVariant &value, uint32_t outerIndex, std::vector<StackValue>::iterator it) {
-		if (it == m_dimensions.end()) {
+	void TypeDescription::doWriteValue(SerializerContext &ctx, const NIFVariant &value, uint32_t outerIndex, const StackValue *it) const {
+		if (it == dimensionsEnd()) {
 			writeSingleValue(ctx, value);
 		}
 		else {
@@ -464,7 +635,7 @@ namespace nifparse {
 				throw std::runtime_error("dynamic array size at outer level");
 			}
 			else {
-				arraySize = std::get<uint32_t>(std::get<NIFArray>(*it).data[outerIndex]);
+				arraySize = dimensionElement(*it, outerIndex);
 			}
 
 			auto &arrayData = std::get<NIFArray>(value);
@@ -480,7 +651,7 @@ namespace nifparse {
 		}
 	}
 
-	void TypeDescription::writeSingleValue(SerializerContext &ctx, const NIFVariant &value) {
+	void TypeDescription::writeSingleValue(SerializerContext &ctx, const NIFVariant &value) const {
 		switch (m_type) {
 		case Type::Null:
 			throw std::runtime_error("attempted to write null type");
@@ -0,0 +1,746 @@
+#include <nifparse/TypePlan.h>
+#include <nifparse/BytecodeReader.h>
+#include <nifparse/Symbols.h>
+#include <nifparse/TypePlanSpecializer.h>
+#include <nifparse/TypePlanCache.h>
+
+#include <algorithm>
+#include <sstream>
+#include <unordered_map>
+
+namespace nifparse {
+	TypePlan::TypePlan(Symbol type) : m_type(type), m_kind(Kind::Compound), m_fixedSize(0), m_stackDepth(0) {
+		BytecodeReader reader(type.typeBytecodeStartOffset());
+
+		if (static_cast<Opcode>(reader.readByte()) != Opcode::BEGIN) {
+			throw std::runtime_error("no OP_BEGIN");
+		}
+
+		if (reader.readVarInt() != type) {
+			throw std::runtime_error("mismatched type ID");
+		}
+
+		auto typeOp = static_cast<Opcode>(reader.readByte());
+
+		switch (typeOp) {
+		case Opcode::COMPOUND:
+			compileCompound(reader);
+			computeReferencedFields();
+			verify();
+			break;
+
+		case Opcode::BITFLAGS:
+			m_kind = Kind::Bitflags;
+			compileEnum(reader);
+			break;
+
+		case Opcode::ENUM:
+			m_kind = Kind::Enum;
+			compileEnum(reader);
+			break;
+
+		default:
+		{
+			std::stringstream error;
+			error << "Unsupported type: " << static_cast<unsigned int>(typeOp);
+			throw std::runtime_error(error.str());
+		}
+		}
+	}
+
+	TypePlan::TypePlan(const TypePlan &generic, const PlanVersion &version) :
+		m_type(generic.m_type),
+		m_kind(generic.m_kind),
+		m_instructions(generic.m_instructions),
+		m_typeDescriptions(generic.m_typeDescriptions),
+		m_defaultValues(generic.m_defaultValues),
+		m_options(generic.m_options),
+		m_inheritedType(generic.m_inheritedType),
+		m_fixedSize(0),
+		m_referencedFields(generic.m_referencedFields),
+		m_stackDepth(0) {
+
+		if (m_kind == Kind::Compound) {
+			TypePlanSpecializer specializer(m_instructions, version);
+			specializer.run();
+			verify();
+		}
+	}
+
+	TypePlan::~TypePlan() = default;
+
+	TypeDescription TypePlan::parseTypeDescription(Opcode opcode, BytecodeReader &reader) {
+		TypeDescription description;
+		if (!description.parse(opcode, reader)) {
+			std::stringstream error;
+			error << "Unknown opcode " << static_cast<unsigned int>(opcode);
+			throw std::runtime_error(error.str());
+		}
+
+		return description;
+	}
+
+	uint32_t TypePlan::addTypeDescription(Opcode opcode, BytecodeReader &reader) {
+		auto index = static_cast<uint32_t>(m_typeDescriptions.size());
+		m_typeDescriptions.emplace_back(parseTypeDescription(opcode, reader));
+		return index;
+	}
+
+	void TypePlan::compileCompound(BytecodeReader &reader) {
+		std::unordered_map<size_t, uint32_t> instructionIndices;
+		std::vector<std::pair<size_t, size_t>> branches;
+		Opcode op;
+
+		do {
+			auto offset = reader.position();
+			instructionIndices.emplace(offset, static_cast<uint32_t>(m_instructions.size()));
+
+			op = static_cast<Opcode>(reader.readByte());
+
+			Instruction insn;
+			insn.opcode = op;
+			insn.operand = 0;
+			insn.operand2 = 0;
+
+			switch (op) {
+			case Opcode::INHERIT:
+			{
+				auto inheritedType = parseTypeDescription(static_cast<Opcode>(reader.readByte()), reader);
+
+				if (inheritedType.type() != TypeDescription::Type::NamedType) {
+					throw std::logic_error("Compound types should only inherit other compound types");
+				}
+
+				insn.operand = inheritedType.typeName();
+				m_inheritedType = inheritedType.typeName();
+				break;
+			}
+
+			case Opcode::IS_TEMPLATE:
+				// Has no effect on (de)serialization.
+				continue;
+
+			case Opcode::SPECIALIZE:
+			{
+				auto specializationOp = static_cast<Opcode>(reader.readByte());
+				if (specializationOp == Opcode::TEMPLATE_ARGUMENT) {
+					insn.opcode = Opcode::SPECIALIZE_TEMPLATE_ARGUMENT;
+				}
+				else if (!m_instructions.empty() && m_instructions.back().opcode == Opcode::LOAD_TYPE) {
+					// Fold the specialization into the type loaded right before it.
+
+					m_typeDescriptions[m_instructions.back().operand].setSpecialization(TypeDescription::intern(parseTypeDescription(specializationOp, reader)));
+					continue;
+				}
+				else {
+					insn.operand = addTypeDescription(specializationOp, reader);
+				}
+
+				break;
+			}
+
+			case Opcode::FIELD:
+			case Opcode::FIELD_INDIRECTION:
+			case Opcode::FIELD_VALUE:
+			case Opcode::STATIC_ARRAY:
+			case Opcode::LITERAL:
+				insn.operand = reader.readVarInt();
+				break;
+
+			case Opcode::FIELD_DEFAULT:
+			{
+				insn.operand = reader.readVarInt();
+
+				DefaultValue value;
+				value.length = reader.readVarInt();
+				value.data = reader.readBytes(value.length);
+
+				insn.operand2 = static_cast<uint32_t>(m_defaultValues.size());
+				m_defaultValues.emplace_back(value);
+				break;
+			}
+
+			case Opcode::HEADER_FIELD:
+				insn.operand = reader.readVarInt();
+				insn.operand2 = insn.operand == symbols::Version ? static_cast<uint32_t>(symbols::Header_String) : static_cast<uint32_t>(Symbol());
+				break;
+
+			case Opcode::BRANCHUNLESS:
+			case Opcode::BRANCHIF:
+			case Opcode::BRANCH:
+			{
+				auto displacementOffset = reader.position();
+				auto displacement = reader.readU16();
+				branches.emplace_back(m_instructions.size(), displacementOffset + displacement);
+				break;
+			}
+
+			case Opcode::IS_NIOBJECT:
+			case Opcode::TEMPLATE_ARGUMENT:
+			case Opcode::DYNAMIC_ARRAY:
+			case Opcode::NOT:
+			case Opcode::MUL:
+			case Opcode::DIV:
+			case Opcode::MOD:
+			case Opcode::ADD:
+			case Opcode::SUB:
+			case Opcode::LSHIFT:
+			case Opcode::RSHIFT:
+			case Opcode::LESSTHAN:
+			case Opcode::LESSOREQUAL:
+			case Opcode::GREATERTHAN:
+			case Opcode::GREATEROREQUAL:
+			case Opcode::EQUAL:
+			case Opcode::NOTEQUAL:
+			case Opcode::BITAND:
+			case Opcode::XOR:
+			case Opcode::BITOR:
+			case Opcode::LOGAND:
+			case Opcode::LOGOR:
+			case Opcode::CONDITION:
+			case Opcode::ARG:
+			case Opcode::SETARG:
+			case Opcode::DUP:
+			case Opcode::END:
+				break;
+
+			default:
+				insn.opcode = Opcode::LOAD_TYPE;
+				insn.operand = addTypeDescription(op, reader);
+				break;
+			}
+
+			m_instructions.emplace_back(insn);
+		} while (op != Opcode::END);
+
+		for (const auto &branch : branches) {
+			auto it = instructionIndices.find(branch.second);
+			if (it == instructionIndices.end()) {
+				std::stringstream error;
+				error << "Branch target " << branch.second << " in " << m_type.toString() << " is not on an instruction boundary";
+				throw std::runtime_error(error.str());
+			}
+
+			m_instructions[branch.first].operand = it->second;
+		}
+	}
+
+	void TypePlan::buildFieldLayout(const NIFFieldLayout *inheritedLayout) {
+		std::vector<Symbol> fields;
+		if (inheritedLayout) {
+			fields = inheritedLayout->fields();
+		}
+
+		for (const auto &insn : m_instructions) {
+			if (insn.opcode == Opcode::FIELD || insn.opcode == Opcode::FIELD_DEFAULT) {
+				Symbol name(insn.operand);
+				if (std::find(fields.begin(), fields.end(), name) == fields.end()) {
+					fields.emplace_back(name);
+				}
+			}
+		}
+
+		m_fieldLayout = std::make_shared<NIFFieldLayout>(std::move(fields));
+	}
+
+	// Size of a single value of the type, or 0 if it depends on the data.
+	static size_t valueSize(const TypeDescription &type, TypePlanCache &plans) {
+		switch (type.type()) {
+		case TypeDescription::Type::Byte:
+		case TypeDescription::Type::Char:
+			return 1;
+
+		case TypeDescription::Type::UShort:
+		case TypeDescription::Type::Flags:
+		case TypeDescription::Type::Short:
+		case TypeDescription::Type::HFloat:
+			return 2;
+
+		case TypeDescription::Type::UInt:
+		case TypeDescription::Type::ULittle32:
+		case TypeDescription::Type::StringIndex:
+		case TypeDescription::Type::StringOffset:
+		case TypeDescription::Type::Int:
+		case TypeDescription::Type::Float:
+		case TypeDescription::Type::Ref:
+		case TypeDescription::Type::Ptr:
+			return 4;
+
+		case TypeDescription::Type::Bool:
+			// Same rule as TypeDescription::readBool, which only a known version decides.
+			if (!plans.isSpecialized() || !(plans.version().presentFields & PlanVersion::HasVersion))
+				return 0;
+
+			return plans.version().version > 0x04000002 ? 1 : 4;
+
+		case TypeDescription::Type::NamedType:
+			return plans.plan(type.typeName()).fixedSize();
+
+		default:
+			return 0;
+		}
+	}
+
+	void TypePlan::analyzeSize(TypePlanCache &plans) {
+		if (m_kind != Kind::Compound) {
+			m_fixedSize = valueSize(storageType(), plans);
+			return;
+		}
+
+		auto layout = std::make_shared<NIFStructLayout>();
+		layout->type = m_type;
+		layout->stride = 0;
+
+		// Only types without inheritance can be stored as a NIFStructArray, as views report a single type.
+		bool hasLayout = m_inheritedType.isNull();
+		size_t size = 0;
+
+		if (!m_inheritedType.isNull()) {
+			size = plans.plan(m_inheritedType).fixedSize();
+			if (size == 0)
+				return;
+		}
+
+		const TypeDescription *fieldType = nullptr;
+		size_t elementCount = 1;
+
+		for (const auto &insn : m_instructions) {
+			switch (insn.opcode) {
+			case Opcode::LOAD_TYPE:
+				fieldType = &m_typeDescriptions[insn.operand];
+				elementCount = 1;
+				break;
+
+			case Opcode::STATIC_ARRAY:
+				elementCount *= insn.operand;
+				hasLayout = false;
+				break;
+
+			case Opcode::SPECIALIZE:
+				// Only matters to template types, whose plans read the template argument and so have no fixed size.
+				break;
+
+			case Opcode::FIELD:
+			{
+				if (!fieldType)
+					return;
+
+				// Field types are only looked up once everything before the field is known to be
+				// unconditional, so that types containing arrays of themselves do not recurse.
+				auto fieldSize = valueSize(*fieldType, plans);
+				if (fieldSize == 0)
+					return;
+
+				if (hasLayout) {
+					NIFStructLayout::Field field;
+					field.name = Symbol(insn.operand);
+					field.offset = layout->stride;
+
+					// Bools are excluded, as default values are read with constant lengths.
+					switch (fieldType->type()) {
+					case TypeDescription::Type::Byte:
+					case TypeDescription::Type::Char:
+						field.type = NIFStructLayout::FieldType::UInt8;
+						break;
+
+					case TypeDescription::Type::UShort:
+					case TypeDescription::Type::Flags:
+						field.type = NIFStructLayout::FieldType::UInt16;
+						break;
+
+					case TypeDescription::Type::Short:
+						field.type = NIFStructLayout::FieldType::Int16;
+						break;
+
+					case TypeDescription::Type::UInt:
+					case TypeDescription::Type::ULittle32:
+					case TypeDescription::Type::StringIndex:
+					case TypeDescription::Type::StringOffset:
+					case TypeDescription::Type::Int:
+						field.type = NIFStructLayout::FieldType::UInt32;
+						break;
+
+					case TypeDescription::Type::Float:
+						field.type = NIFStructLayout::FieldType::Float;
+						break;
+
+					case TypeDescription::Type::HFloat:
+						field.type = NIFStructLayout::FieldType::HalfFloat;
+						break;
+
+					case TypeDescription::Type::NamedType:
+					{
+						const auto &fieldPlan = plans.plan(fieldType->typeName());
+						if (fieldPlan.kind() == Kind::Compound && fieldPlan.structLayout()) {
+							field.type = NIFStructLayout::FieldType::Compound;
+							field.layout = fieldPlan.structLayout();
+						}
+						else {
+							hasLayout = false;
+						}
+						break;
+					}
+
+					default:
+						hasLayout = false;
+						break;
+					}
+
+					if (hasLayout) {
+						layout->fields.emplace_back(std::move(field));
+						layout->stride += static_cast<uint32_t>(fieldSize);
+					}
+				}
+
+				size += fieldSize * elementCount;
+				fieldType = nullptr;
+				break;
+			}
+
+			case Opcode::FIELD_DEFAULT:
+				// Takes nothing from the file, but the value is not in the bytes a NIFStructArray keeps.
+				hasLayout = false;
+				fieldType = nullptr;
+				break;
+
+			case Opcode::IS_NIOBJECT:
+				hasLayout = false;
+				break;
+
+			case Opcode::INHERIT:
+			case Opcode::NOP:
+			case Opcode::END:
+				break;
+
+			default:
+				// Anything else makes the size depend on the data.
+				return;
+			}
+		}
+
+		m_fixedSize = size;
+
+		if (hasLayout && !layout->fields.empty())
+			m_structLayout = std::move(layout);
+	}
+
+	void TypePlan::computeReferencedFields() {
+		bool indirect = false;
+
+		for (const auto &insn : m_instructions) {
+			switch (insn.opcode) {
+			case Opcode::FIELD_INDIRECTION:
+			case Opcode::FIELD_VALUE:
+			case Opcode::FIELD_NUMBER:
+			{
+				// Only the first name of a path is looked up in this dictionary; the whole field is kept.
+				Symbol name(insn.operand);
+				if (!indirect && std::find(m_referencedFields.begin(), m_referencedFields.end(), name) == m_referencedFields.end()) {
+					m_referencedFields.emplace_back(name);
+				}
+
+				indirect = insn.opcode == Opcode::FIELD_INDIRECTION;
+				break;
+			}
+
+			default:
+				indirect = false;
+				break;
+			}
+		}
+	}
+
+	void TypePlan::stackEffect(Opcode op, unsigned int &pops, unsigned int &pushes) {
+		switch (op) {
+		case Opcode::LITERAL:
+		case Opcode::HEADER_FIELD:
+		case Opcode::FIELD_VALUE:
+		case Opcode::FIELD_NUMBER:
+		case Opcode::ARG:
+			pops = 0;
+			pushes = 1;
+			break;
+
+		case Opcode::NOT:
+			pops = 1;
+			pushes = 1;
+			break;
+
+		case Opcode::MUL:
+		case Opcode::DIV:
+		case Opcode::MOD:
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::LSHIFT:
+		case Opcode::RSHIFT:
+		case Opcode::LESSTHAN:
+		case Opcode::LESSOREQUAL:
+		case Opcode::GREATERTHAN:
+		case Opcode::GREATEROREQUAL:
+		case Opcode::EQUAL:
+		case Opcode::NOTEQUAL:
+		case Opcode::BITAND:
+		case Opcode::XOR:
+		case Opcode::BITOR:
+		case Opcode::LOGAND:
+		case Opcode::LOGOR:
+			pops = 2;
+			pushes = 1;
+			break;
+
+		case Opcode::DUP:
+			pops = 1;
+			pushes = 2;
+			break;
+
+		case Opcode::CONDITION:
+		case Opcode::SETARG:
+		case Opcode::DYNAMIC_ARRAY:
+		case Opcode::BRANCHIF:
+		case Opcode::BRANCHUNLESS:
+			pops = 1;
+			pushes = 0;
+			break;
+
+		default:
+			pops = 0;
+			pushes = 0;
+			break;
+		}
+	}
+
+	void TypePlan::verify() {
+		// A value on the operand stack, as far as can be told before running the plan.
+		struct Operand {
+			bool isNumber;
+
+			// FIELD_VALUE instructions the value may come from; those fields could hold arrays.
+			std::vector<size_t> fieldValues;
+		};
+
+		auto fail = [this](size_t index, const char *problem) {
+			std::stringstream error;
+			error << "Instruction " << index << " in " << m_type.toString() << " " << problem;
+			throw std::runtime_error(error.str());
+		};
+
+		// The stack on entry to each instruction. Branches only lead forward, so every path into an instruction is known once it is reached.
+		std::vector<std::vector<Operand>> entryStacks(m_instructions.size());
+		std::vector<bool> reached(m_instructions.size(), false);
+		std::vector<bool> takenAsNumber(m_instructions.size(), false);
+		std::vector<bool> takenAsArray(m_instructions.size(), false);
+
+		auto flowTo = [&](size_t from, size_t to, const std::vector<Operand> &stack) {
+			if (to <= from || to >= m_instructions.size())
+				fail(from, "does not lead forward to another instruction");
+
+			auto &entry = entryStacks[to];
+
+			if (!reached[to]) {
+				entry = stack;
+				reached[to] = true;
+				return;
+			}
+
+			if (entry.size() != stack.size())
+				fail(to, "is reached with different operand stack depths");
+
+			for (size_t slot = 0; slot < stack.size(); slot++) {
+				entry[slot].isNumber = entry[slot].isNumber && stack[slot].isNumber;
+				entry[slot].fieldValues.insert(entry[slot].fieldValues.end(), stack[slot].fieldValues.begin(), stack[slot].fieldValues.end());
+			}
+		};
+
+		auto verifyType = [&](size_t index, const TypeDescription &description) {
+			if (description.type() == TypeDescription::Type::NamedType && !description.typeName().isTypeName())
+				fail(index, "loads a type that is not defined");
+		};
+
+		if (!m_instructions.empty())
+			reached[0] = true;
+
+		m_stackDepth = 0;
+
+		for (size_t index = 0; index < m_instructions.size(); index++) {
+			if (!reached[index])
+				continue;
+
+			const auto &insn = m_instructions[index];
+			auto stack = std::move(entryStacks[index]);
+
+			unsigned int pops, pushes;
+			stackEffect(insn.opcode, pops, pushes);
+
+			if (stack.size() < pops)
+				fail(index, "can underflow the operand stack");
+
+			switch (insn.opcode) {
+			case Opcode::IS_NIOBJECT:
+			case Opcode::SPECIALIZE_TEMPLATE_ARGUMENT:
+			case Opcode::FIELD:
+			case Opcode::TEMPLATE_ARGUMENT:
+			case Opcode::STATIC_ARRAY:
+			case Opcode::FIELD_INDIRECTION:
+			case Opcode::BRANCH:
+			case Opcode::END:
+				break;
+
+			case Opcode::INHERIT:
+				if (!Symbol(insn.operand).isTypeName())
+					fail(index, "inherits from a type that is not defined");
+
+				break;
+
+			case Opcode::LOAD_TYPE:
+			case Opcode::SPECIALIZE:
+				if (insn.operand >= m_typeDescriptions.size())
+					fail(index, "refers past the type descriptions of the plan");
+
+				verifyType(index, m_typeDescriptions[insn.operand]);
+				if (m_typeDescriptions[insn.operand].specialization())
+					verifyType(index, *m_typeDescriptions[insn.operand].specialization());
+				break;
+
+			case Opcode::FIELD_DEFAULT:
+				if (insn.operand2 >= m_defaultValues.size())
+					fail(index, "refers past the default values of the plan");
+
+				break;
+
+			case Opcode::FIELD_VALUE:
+				stack.push_back(Operand{ false, { index } });
+				break;
+
+			case Opcode::DUP:
+				stack.push_back(stack.back());
+				break;
+
+			case Opcode::DYNAMIC_ARRAY:
+				// Takes arrays as well as numbers.
+				for (auto fieldValue : stack.back().fieldValues) {
+					takenAsArray[fieldValue] = true;
+				}
+
+				stack.pop_back();
+				break;
+
+			case Opcode::LITERAL:
+			case Opcode::HEADER_FIELD:
+			case Opcode::ARG:
+			case Opcode::FIELD_NUMBER:
+			case Opcode::NOT:
+			case Opcode::MUL:
+			case Opcode::DIV:
+			case Opcode::MOD:
+			case Opcode::ADD:
+			case Opcode::SUB:
+			case Opcode::LSHIFT:
+			case Opcode::RSHIFT:
+			case Opcode::LESSTHAN:
+			case Opcode::LESSOREQUAL:
+			case Opcode::GREATERTHAN:
+			case Opcode::GREATEROREQUAL:
+			case Opcode::EQUAL:
+			case Opcode::NOTEQUAL:
+			case Opcode::BITAND:
+			case Opcode::XOR:
+			case Opcode::BITOR:
+			case Opcode::LOGAND:
+			case Opcode::LOGOR:
+			case Opcode::CONDITION:
+			case Opcode::SETARG:
+			case Opcode::BRANCHIF:
+			case Opcode::BRANCHUNLESS:
+				for (unsigned int pop = 0; pop < pops; pop++) {
+					for (auto fieldValue : stack.back().fieldValues) {
+						takenAsNumber[fieldValue] = true;
+					}
+
+					stack.pop_back();
+				}
+
+				for (unsigned int push = 0; push < pushes; push++) {
+					stack.push_back(Operand{ true, {} });
+				}
+
+				break;
+
+			default:
+				fail(index, "is not an instruction the interpreter runs");
+			}
+
+			m_stackDepth = std::max(m_stackDepth, stack.size());
+
+			switch (insn.opcode) {
+			case Opcode::END:
+				break;
+
+			case Opcode::BRANCH:
+				flowTo(index, insn.operand, stack);
+				break;
+
+			case Opcode::BRANCHIF:
+			case Opcode::BRANCHUNLESS:
+				flowTo(index, insn.operand, stack);
+				flowTo(index, index + 1, stack);
+				break;
+
+			default:
+				flowTo(index, index + 1, stack);
+				break;
+			}
+		}
+
+		if (m_stackDepth > MaxStackDepth) {
+			std::stringstream error;
+			error << m_type.toString() << " needs " << m_stackDepth << " operand stack slots, more than the " << MaxStackDepth << " the interpreter has";
+			throw std::runtime_error(error.str());
+		}
+
+		/*
+		 * Field values that are used as numbers are checked to be numbers when
+		 * they are read, instead of everywhere they are used. That would break
+		 * a value that also reaches DYNAMIC_ARRAY, through DUP or a join, and
+		 * the interpreter does not check it otherwise, so such plans are
+		 * rejected.
+		 */
+		for (size_t index = 0; index < m_instructions.size(); index++) {
+			if (takenAsNumber[index] && takenAsArray[index])
+				fail(index, "reads a field value that is used both as a number and as an array");
+
+			if (takenAsNumber[index])
+				m_instructions[index].opcode = Opcode::FIELD_NUMBER;
+		}
+	}
+
+	void TypePlan::compileEnum(BytecodeReader &reader) {
+		addTypeDescription(static_cast<Opcode>(reader.readByte()), reader);
+
+		Opcode op;
+
+		do {
+			op = static_cast<Opcode>(reader.readByte());
+
+			switch (op) {
+			case Opcode::OPTION:
+			{
+				Option option;
+				option.name = Symbol(reader.readVarInt());
+				option.value = reader.readVarInt();
+				m_options.emplace_back(option);
+				break;
+			}
+
+			case Opcode::END:
+				break;
+
+			default:
+			{
+				std::stringstream error;
+				error << "Unknown opcode " << static_cast<unsigned int>(op);
+				throw std::runtime_error(error.str());
+			}
+			}
+		} while (op != Opcode::END);
+	}
+}
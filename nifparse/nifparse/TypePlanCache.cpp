@@ -0,0 +1,83 @@
+#include <nifparse/TypePlanCache.h>
+#include <nifparse/TypePlan.h>
+
+#include <map>
+#include <sstream>
+
+namespace nifparse {
+	TypePlanCache::TypePlanCache() :
+		m_specialized(false),
+		m_symbolCount(Symbol::count()),
+		m_plans(new std::atomic<const TypePlan *>[m_symbolCount]()) {
+
+	}
+
+	TypePlanCache::TypePlanCache(const PlanVersion &version) :
+		m_specialized(true),
+		m_version(version),
+		m_symbolCount(Symbol::count()),
+		m_plans(new std::atomic<const TypePlan *>[m_symbolCount]()) {
+
+	}
+
+	TypePlanCache::~TypePlanCache() = default;
+
+	const TypePlan &TypePlanCache::compile(Symbol type) {
+		if (static_cast<uint32_t>(type) >= m_symbolCount) {
+			std::stringstream error;
+			error << "Symbol does not represent a type: " << static_cast<uint32_t>(type);
+			throw std::runtime_error(error.str());
+		}
+
+		// Plans are compiled without holding the lock, as the inherited plan has to be
+		// looked up for the field layout. A racing thread may compile the same plan
+		// twice, in which case the copy published first wins.
+		std::unique_ptr<TypePlan> compiledPlan;
+		if (m_specialized)
+			compiledPlan = std::make_unique<TypePlan>(instance().plan(type), m_version);
+		else
+			compiledPlan = std::make_unique<TypePlan>(type);
+
+		if (compiledPlan->kind() == TypePlan::Kind::Compound) {
+			auto inheritedType = compiledPlan->inheritedType();
+			compiledPlan->buildFieldLayout(inheritedType.isNull() ? nullptr : plan(inheritedType).fieldLayout().get());
+		}
+
+		compiledPlan->analyzeSize(*this);
+
+		std::unique_lock<std::mutex> locker(m_compileMutex);
+
+		auto plan = m_plans[type].load(std::memory_order_acquire);
+		if (plan)
+			return *plan;
+
+		plan = compiledPlan.get();
+		m_compiledPlans.emplace_back(std::move(compiledPlan));
+
+		m_plans[type].store(plan, std::memory_order_release);
+
+		return *plan;
+	}
+
+	size_t TypePlanCache::fixedSize(Symbol type) {
+		return plan(type).fixedSize();
+	}
+
+	TypePlanCache &TypePlanCache::instance() {
+		static TypePlanCache cache;
+		return cache;
+	}
+
+	TypePlanCache &TypePlanCache::forVersion(const PlanVersion &version) {
+		static std::mutex cachesMutex;
+		static std::map<PlanVersion, std::unique_ptr<TypePlanCache>> caches;
+
+		std::unique_lock<std::mutex> locker(cachesMutex);
+
+		auto &cache = caches[version];
+		if (!cache)
+			cache = std::make_unique<TypePlanCache>(version);
+
+		return *cache;
+	}
+}
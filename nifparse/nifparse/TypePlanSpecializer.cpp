@@ -0,0 +1,400 @@
+#include <nifparse/TypePlanSpecializer.h>
+#include <nifparse/Serializer.h>
+
+namespace nifparse {
+	TypePlanSpecializer::TypePlanSpecializer(std::vector<TypePlan::Instruction> &instructions, const PlanVersion &version) :
+		m_instructions(instructions), m_version(version) {
+
+	}
+
+	TypePlanSpecializer::~TypePlanSpecializer() = default;
+
+	void TypePlanSpecializer::run() {
+		bool changed;
+
+		do {
+			changed = false;
+
+			findBranchTargets();
+
+			for (size_t index = 0; index < m_instructions.size(); index++) {
+				if (foldInstruction(index))
+					changed = true;
+			}
+
+			if (removeUnreachable())
+				changed = true;
+
+		} while (changed);
+
+		compact();
+	}
+
+	bool TypePlanSpecializer::isControlFlow(Opcode op) {
+		return op == Opcode::BRANCH || op == Opcode::BRANCHIF || op == Opcode::BRANCHUNLESS || op == Opcode::END;
+	}
+
+	void TypePlanSpecializer::findBranchTargets() {
+		m_branchTargets.assign(m_instructions.size() + 1, false);
+
+		for (const auto &insn : m_instructions) {
+			if (insn.opcode == Opcode::BRANCH || insn.opcode == Opcode::BRANCHIF || insn.opcode == Opcode::BRANCHUNLESS) {
+				m_branchTargets[insn.operand] = true;
+			}
+		}
+	}
+
+	bool TypePlanSpecializer::foldInstruction(size_t index) {
+		auto &insn = m_instructions[index];
+		auto op = insn.opcode;
+
+		switch (op) {
+		case Opcode::HEADER_FIELD:
+		{
+			uint32_t value;
+			if (!m_version.headerField(Symbol(insn.operand), value))
+				return false;
+
+			replaceWithLiteral(index, value);
+			return true;
+		}
+
+		case Opcode::NOT:
+		{
+			auto operand = findProducer(index, 0);
+			if (!isLiteral(operand))
+				return false;
+
+			auto value = Serializer::evaluateUnary(op, m_instructions[operand].operand);
+			remove(operand);
+			replaceWithLiteral(index, value);
+			return true;
+		}
+
+		case Opcode::MUL:
+		case Opcode::DIV:
+		case Opcode::MOD:
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::LSHIFT:
+		case Opcode::RSHIFT:
+		case Opcode::LESSTHAN:
+		case Opcode::LESSOREQUAL:
+		case Opcode::GREATERTHAN:
+		case Opcode::GREATEROREQUAL:
+		case Opcode::EQUAL:
+		case Opcode::NOTEQUAL:
+		case Opcode::BITAND:
+		case Opcode::XOR:
+		case Opcode::BITOR:
+		case Opcode::LOGAND:
+		case Opcode::LOGOR:
+		{
+			auto right = findProducer(index, 0);
+			auto left = findProducer(index, 1);
+
+			if (isLiteral(left) && isLiteral(right)) {
+				auto leftValue = m_instructions[left].operand;
+				auto rightValue = m_instructions[right].operand;
+
+				// Leave division by zero to fail at run time, if it is ever reached.
+				if ((op == Opcode::DIV || op == Opcode::MOD) && rightValue == 0)
+					return false;
+
+				auto value = Serializer::evaluateBinary(op, leftValue, rightValue);
+				remove(left);
+				remove(right);
+				replaceWithLiteral(index, value);
+				return true;
+			}
+
+			if (op == Opcode::LOGAND || op == Opcode::LOGOR)
+				return foldLogical(index, left, right);
+
+			return false;
+		}
+
+		case Opcode::DUP:
+		{
+			auto operand = findProducer(index, 0);
+			if (!isLiteral(operand))
+				return false;
+
+			replaceWithLiteral(index, m_instructions[operand].operand);
+			return true;
+		}
+
+		case Opcode::BRANCHIF:
+		case Opcode::BRANCHUNLESS:
+		{
+			auto operand = findProducer(index, 0);
+			if (!isLiteral(operand))
+				return false;
+
+			bool taken = (m_instructions[operand].operand != 0) == (op == Opcode::BRANCHIF);
+
+			remove(operand);
+
+			if (taken)
+				insn.opcode = Opcode::BRANCH;
+			else
+				remove(index);
+
+			return true;
+		}
+
+		case Opcode::CONDITION:
+		{
+			auto operand = findProducer(index, 0);
+			if (!isLiteral(operand))
+				return false;
+
+			return foldCondition(index, operand);
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	bool TypePlanSpecializer::foldCondition(size_t index, size_t producer) {
+		auto next = nextLive(index);
+		if (next == NotFound)
+			return false;
+
+		/*
+		 * Every FIELD and FIELD_DEFAULT leaves the field marked present, so a
+		 * true condition has nothing to do, and neither has any condition
+		 * that is immediately followed by a default value assignment.
+		 */
+		if (m_instructions[producer].operand != 0 || m_instructions[next].opcode == Opcode::FIELD_DEFAULT) {
+			remove(producer);
+			remove(index);
+			return true;
+		}
+
+		if (m_instructions[next].opcode != Opcode::FIELD)
+			return false;
+
+		for (size_t position = index + 1; position <= next; position++) {
+			if (m_branchTargets[position])
+				return false;
+		}
+
+		/*
+		 * A field that is never present can be dropped together with its
+		 * type setup, as long as the next field starts by loading a fresh
+		 * type description and so does not see the description it leaves
+		 * behind.
+		 */
+		auto following = nextLive(next);
+		if (following == NotFound)
+			return false;
+
+		auto followingOp = m_instructions[following].opcode;
+		if (followingOp != Opcode::LOAD_TYPE && followingOp != Opcode::TEMPLATE_ARGUMENT && followingOp != Opcode::END)
+			return false;
+
+		remove(producer);
+		remove(index);
+		remove(next);
+		removeFieldSetup(index);
+
+		return true;
+	}
+
+	bool TypePlanSpecializer::foldLogical(size_t index, size_t left, size_t right) {
+		// 'x && 1' and 'x || 0' are just 'x' when x is already 0 or 1.
+		uint32_t identity = m_instructions[index].opcode == Opcode::LOGAND ? 1 : 0;
+
+		auto isIdentity = [&](size_t operand) {
+			return isLiteral(operand) && (m_instructions[operand].operand != 0) == (identity != 0);
+		};
+
+		if (isIdentity(left) && producesBoolean(right)) {
+			remove(left);
+			remove(index);
+			return true;
+		}
+
+		if (isIdentity(right) && producesBoolean(left)) {
+			remove(right);
+			remove(index);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool TypePlanSpecializer::removeUnreachable() {
+		bool changed = false;
+		bool reachable = true;
+
+		for (size_t index = 0; index < m_instructions.size(); index++) {
+			if (m_branchTargets[index])
+				reachable = true;
+
+			auto &insn = m_instructions[index];
+
+			if (insn.opcode == Opcode::NOP)
+				continue;
+
+			if (!reachable) {
+				remove(index);
+				changed = true;
+				continue;
+			}
+
+			if (insn.opcode == Opcode::BRANCH) {
+				auto next = nextLive(index);
+
+				if (next != NotFound && insn.operand > index && next >= insn.operand) {
+					remove(index);
+					changed = true;
+				}
+				else {
+					reachable = false;
+				}
+			}
+			else if (insn.opcode == Opcode::END) {
+				reachable = false;
+			}
+		}
+
+		return changed;
+	}
+
+	void TypePlanSpecializer::removeFieldSetup(size_t field) {
+		for (size_t index = field; index-- > 0; ) {
+			if (m_branchTargets[index + 1])
+				break;
+
+			auto op = m_instructions[index].opcode;
+
+			if (op == Opcode::NOP)
+				continue;
+
+			if (op == Opcode::SPECIALIZE || op == Opcode::SPECIALIZE_TEMPLATE_ARGUMENT || op == Opcode::STATIC_ARRAY) {
+				remove(index);
+			}
+			else if (op == Opcode::LOAD_TYPE || op == Opcode::TEMPLATE_ARGUMENT) {
+				remove(index);
+				break;
+			}
+			else {
+				break;
+			}
+		}
+	}
+
+	void TypePlanSpecializer::compact() {
+		std::vector<uint32_t> newIndices(m_instructions.size() + 1);
+
+		uint32_t liveCount = 0;
+		for (size_t index = 0; index < m_instructions.size(); index++) {
+			newIndices[index] = liveCount;
+
+			if (m_instructions[index].opcode != Opcode::NOP)
+				liveCount++;
+		}
+
+		newIndices[m_instructions.size()] = liveCount;
+
+		size_t output = 0;
+		for (size_t index = 0; index < m_instructions.size(); index++) {
+			auto insn = m_instructions[index];
+			if (insn.opcode == Opcode::NOP)
+				continue;
+
+			if (insn.opcode == Opcode::BRANCH || insn.opcode == Opcode::BRANCHIF || insn.opcode == Opcode::BRANCHUNLESS) {
+				insn.operand = newIndices[insn.operand];
+			}
+
+			m_instructions[output++] = insn;
+		}
+
+		m_instructions.resize(output);
+	}
+
+	size_t TypePlanSpecializer::findProducer(size_t consumer, unsigned int depth) const {
+		// Only looks within the basic block of the consumer.
+
+		unsigned int needed = depth;
+
+		for (size_t index = consumer; index-- > 0; ) {
+			if (m_branchTargets[index + 1])
+				return NotFound;
+
+			auto op = m_instructions[index].opcode;
+
+			if (op == Opcode::NOP)
+				continue;
+
+			if (isControlFlow(op))
+				return NotFound;
+
+			unsigned int pops, pushes;
+			TypePlan::stackEffect(op, pops, pushes);
+
+			if (needed < pushes)
+				return index;
+
+			needed = needed - pushes + pops;
+		}
+
+		return NotFound;
+	}
+
+	size_t TypePlanSpecializer::nextLive(size_t index) const {
+		for (size_t next = index + 1; next < m_instructions.size(); next++) {
+			if (m_instructions[next].opcode != Opcode::NOP)
+				return next;
+		}
+
+		return NotFound;
+	}
+
+	bool TypePlanSpecializer::isLiteral(size_t index) const {
+		return index != NotFound && m_instructions[index].opcode == Opcode::LITERAL;
+	}
+
+	bool TypePlanSpecializer::producesBoolean(size_t index) const {
+		if (index == NotFound)
+			return false;
+
+		const auto &insn = m_instructions[index];
+
+		switch (insn.opcode) {
+		case Opcode::LESSTHAN:
+		case Opcode::LESSOREQUAL:
+		case Opcode::GREATERTHAN:
+		case Opcode::GREATEROREQUAL:
+		case Opcode::EQUAL:
+		case Opcode::NOTEQUAL:
+		case Opcode::LOGAND:
+		case Opcode::LOGOR:
+		case Opcode::NOT:
+			return true;
+
+		case Opcode::LITERAL:
+			return insn.operand <= 1;
+
+		default:
+			return false;
+		}
+	}
+
+	void TypePlanSpecializer::remove(size_t index) {
+		auto &insn = m_instructions[index];
+		insn.opcode = Opcode::NOP;
+		insn.operand = 0;
+		insn.operand2 = 0;
+	}
+
+	void TypePlanSpecializer::replaceWithLiteral(size_t index, uint32_t value) {
+		auto &insn = m_instructions[index];
+		insn.opcode = Opcode::LITERAL;
+		insn.operand = value;
+		insn.operand2 = 0;
+	}
+}
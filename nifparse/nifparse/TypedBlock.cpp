@@ -0,0 +1,22 @@
+#include <nifparse/TypedBlock.h>
+
+namespace nifparse {
+	TypedBlock::~TypedBlock() = default;
+
+	TypedBlockFunction TypedBlockReader::find(Symbol type) {
+		static const std::vector<TypedBlockFunction> functions = [] {
+			std::vector<TypedBlockFunction> table(Symbol::count(), nullptr);
+
+			for (size_t index = 0; index < m_entryCount; index++) {
+				table[m_entries[index].type] = m_entries[index].function;
+			}
+
+			return table;
+		}();
+
+		if (static_cast<uint32_t>(type) >= functions.size())
+			return nullptr;
+
+		return functions[type];
+	}
+}
@@ -1,6 +1,65 @@
 #include <nifparse/Types.h>
 
+#include <half.h>
+
+#include <algorithm>
+#include <cstring>
+
 namespace nifparse {
+	NIFFieldLayout::NIFFieldLayout(std::vector<Symbol> &&fields) : m_fields(std::move(fields)), m_hashShift(32) {
+		if (m_fields.empty())
+			return;
+
+		// Keep the table at most half full, so that probe sequences stay short.
+		size_t indexSize = 1;
+		while (indexSize < m_fields.size() * 2) {
+			indexSize *= 2;
+			m_hashShift--;
+		}
+
+		m_index.resize(indexSize, 0);
+
+		auto mask = indexSize - 1;
+
+		for (size_t slot = 0; slot < m_fields.size(); slot++) {
+			auto position = hash(m_fields[slot]);
+			while (m_index[position] != 0) {
+				position = (position + 1) & mask;
+			}
+
+			m_index[position] = static_cast<uint32_t>(slot + 1);
+		}
+	}
+
+	NIFFieldLayout::~NIFFieldLayout() = default;
+
+	void NIFFieldMap::setLayout(std::shared_ptr<const NIFFieldLayout> layout) {
+		if (!m_slots.empty())
+			throw std::logic_error("field layout can only be changed while the dictionary is empty");
+
+		m_layout = std::move(layout);
+	}
+
+	size_t NIFFieldMap::size() const {
+		return std::count_if(m_slots.begin(), m_slots.end(), [](const value_type &slot) { return !slot.first.isNull(); });
+	}
+
+	size_t NIFFieldMap::erase(Symbol key) {
+		auto slot = findSlot(key);
+		if (slot == NIFFieldLayout::NoSlot)
+			return 0;
+
+		m_slots[slot].first = Symbol();
+		m_slots[slot].second = NIFVariant();
+		return 1;
+	}
+
+	void NIFFieldMap::allocateSlots() {
+		if (m_slots.empty() && m_layout) {
+			m_slots.resize(m_layout->size());
+		}
+	}
+
 	bool NIFDictionary::isA(const Symbol &type) const {
 		return !typeChain.empty() && typeChain.front() == type;
 	}
@@ -8,4 +67,147 @@ namespace nifparse {
 	bool NIFDictionary::kindOf(const Symbol &type) const {
 		return std::find(typeChain.begin(), typeChain.end(), type) != typeChain.end();
 	}
+
+	const NIFStructLayout::Field *NIFStructLayout::findField(Symbol name) const {
+		// Search backwards: a repeated field name overwrites the earlier value in a dictionary.
+		for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+			if (it->name == name)
+				return &*it;
+		}
+
+		return nullptr;
+	}
+
+	template<typename T>
+	static T loadField(const unsigned char *data) {
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	static NIFVariant fieldValue(const NIFStructLayout::Field &field, const unsigned char *data) {
+		data += field.offset;
+
+		switch (field.type) {
+		case NIFStructLayout::FieldType::UInt8:
+			return static_cast<uint32_t>(loadField<uint8_t>(data));
+
+		case NIFStructLayout::FieldType::UInt16:
+			return static_cast<uint32_t>(loadField<uint16_t>(data));
+
+		case NIFStructLayout::FieldType::Int16:
+			return static_cast<uint32_t>(loadField<int16_t>(data));
+
+		case NIFStructLayout::FieldType::UInt32:
+			return loadField<uint32_t>(data);
+
+		case NIFStructLayout::FieldType::Float:
+			return loadField<float>(data);
+
+		case NIFStructLayout::FieldType::HalfFloat:
+		{
+			auto bits = half_to_float(loadField<uint16_t>(data));
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		case NIFStructLayout::FieldType::Compound:
+			return NIFStructView(*field.layout, data).toDictionary();
+
+		default:
+			throw std::logic_error("unknown struct field type");
+		}
+	}
+
+	NIFVariant NIFStructView::value(Symbol key) const {
+		auto field = m_layout->findField(key);
+		if (!field) {
+			std::stringstream stream;
+			stream << "No key " << key.toString() << " in " << m_layout->type.toString();
+			throw std::runtime_error(stream.str());
+		}
+
+		return fieldValue(*field, m_data);
+	}
+
+	NIFDictionary NIFStructView::toDictionary() const {
+		NIFDictionary dict;
+		dict.typeChain.emplace_back(m_layout->type);
+		dict.isNiObject = false;
+
+		for (const auto &field : m_layout->fields) {
+			auto value = fieldValue(field, m_data);
+			auto result = dict.data.try_emplace(field.name, value);
+			if (!result.second) {
+				result.first->second = std::move(value);
+			}
+		}
+
+		return dict;
+	}
+
+	size_t arraySize(const NIFVariant &array) {
+		return std::visit([](auto &&val) -> size_t {
+			using T = std::decay_t<decltype(val)>;
+
+			if constexpr (std::is_same_v<T, NIFArray>) {
+				return val.data.size();
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<unsigned char>> || std::is_same_v<T, NIFString> ||
+				std::is_same_v<T, NIFVector<uint16_t>> || std::is_same_v<T, NIFVector<int16_t>> ||
+				std::is_same_v<T, NIFVector<uint32_t>> || std::is_same_v<T, NIFVector<float>> ||
+				std::is_same_v<T, NIFStructArray>) {
+				return val.size();
+			}
+			else {
+				throw std::runtime_error("value is not an array");
+			}
+		}, array);
+	}
+
+	NIFVariant arrayElement(const NIFVariant &array, size_t index) {
+		return std::visit([=](auto &&val) -> NIFVariant {
+			using T = std::decay_t<decltype(val)>;
+
+			if constexpr (std::is_same_v<T, NIFArray>) {
+				return val.data.at(index);
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<unsigned char>> || std::is_same_v<T, NIFString>) {
+				return static_cast<uint32_t>(static_cast<unsigned char>(val.at(index)));
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<uint16_t>> || std::is_same_v<T, NIFVector<int16_t>> ||
+				std::is_same_v<T, NIFVector<uint32_t>>) {
+				return static_cast<uint32_t>(val.at(index));
+			}
+			else if constexpr (std::is_same_v<T, NIFVector<float>>) {
+				return val.at(index);
+			}
+			else if constexpr (std::is_same_v<T, NIFStructArray>) {
+				if (index >= val.size())
+					throw std::out_of_range("struct array index out of range");
+
+				return val[index].toDictionary();
+			}
+			else {
+				throw std::runtime_error("value is not an array");
+			}
+		}, array);
+	}
+
+	uint32_t dimensionElement(const StackValue &dimension, size_t index) {
+		return std::visit([=](auto &&val) -> uint32_t {
+			using T = std::decay_t<decltype(val)>;
+
+			if constexpr (std::is_same_v<T, uint32_t>) {
+				throw std::logic_error("array dimension is not an array");
+			}
+			else if constexpr (std::is_same_v<T, const NIFArray *>) {
+				return std::get<uint32_t>(val->data[index]);
+			}
+			else {
+				return static_cast<uint32_t>((*val)[index]);
+			}
+		}, dimension);
+	}
 }